@@ -13,6 +13,7 @@ enum BlockType {
     Water,
     Stone,
     Wood,
+    Leaves,
     NumTypes,
 };
 
@@ -27,7 +28,8 @@ std::unordered_map<int, std::vector<std::pair<int, int>>> textureCoordMap = {
     {BlockType::Dirt, {{2, 0}, {2, 0}, {2, 0}, {2, 0}, {2, 0}, {2, 0}}},
     {BlockType::Water, {{13, 12}, {13, 12}, {13, 12}, {13, 12}, {13, 12}, {13, 12}}},
     {BlockType::Stone, {{1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}}},
-    {BlockType::Wood, {{4, 0}, {4, 0}, {4, 0}, {4, 0}, {4, 0}, {4, 0}}}
+    {BlockType::Wood, {{4, 0}, {4, 0}, {4, 0}, {4, 0}, {4, 0}, {4, 0}}},
+    {BlockType::Leaves, {{5, 3}, {5, 3}, {5, 3}, {5, 3}, {5, 3}, {5, 3}}}
 };
 
 
@@ -39,6 +41,9 @@ struct Block {
     Block(){};
     ~Block(){};
     BlockType blockType =  BlockType::Default;
+
+    // translucent blocks are meshed separately and drawn with blending
+    inline bool isTranslucent() const { return blockType == BlockType::Water; }
 };
 
 #endif // BLOCK_H
\ No newline at end of file
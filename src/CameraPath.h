@@ -0,0 +1,116 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include "Camera.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+    Recorded camera flights, so a performance problem found by flying
+    around can be replayed exactly, in headless mode, as often as needed.
+
+        --record FILE   windowed, saves the camera of every frame on exit
+        --replay FILE   headless, one recorded frame per fixed timestep
+
+    File layout, host byte order (little endian on everything we build for):
+        char     magic[4]  "WCAM"
+        uint32_t version   CAMERA_PATH_VERSION
+        uint32_t frames
+        frames x CameraSample
+*/
+
+constexpr uint32_t CAMERA_PATH_VERSION = 1;
+
+// what the chunk manager looks at, yaw/pitch/right follow from front
+struct CameraSample {
+    float position[3];
+    float front[3];
+    float fov;
+    float zFar;
+};
+static_assert(sizeof(CameraSample) == 32, "CameraSample is written as is");
+
+struct CameraRecorder {
+    std::vector<CameraSample> samples;
+
+    void record(const Camera &camera);
+    bool save(const std::string &path) const;
+};
+
+void CameraRecorder::record(const Camera &camera) {
+    CameraSample sample;
+    for (int i = 0; i < 3; i++) {
+        sample.position[i] = camera.cameraPos[i];
+        sample.front[i] = camera.cameraFront[i];
+    }
+    sample.fov = camera.fov;
+    sample.zFar = camera.zFar;
+    samples.push_back(sample);
+}
+
+bool CameraRecorder::save(const std::string &path) const {
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        std::printf("camera path: can't write %s\n", path.c_str());
+        return false;
+    }
+    uint32_t frames = (uint32_t)samples.size();
+    bool ok = std::fwrite("WCAM", 1, 4, file) == 4 &&
+              std::fwrite(&CAMERA_PATH_VERSION, sizeof(uint32_t), 1, file) == 1 &&
+              std::fwrite(&frames, sizeof(uint32_t), 1, file) == 1 &&
+              std::fwrite(samples.data(), sizeof(CameraSample), frames, file) ==
+                  frames;
+    std::fclose(file);
+    return ok;
+}
+
+bool LoadCameraPath(const std::string &path, std::vector<CameraSample> &samples) {
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (file == NULL) {
+        std::printf("camera path: can't open %s\n", path.c_str());
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t frames = 0;
+    bool ok = std::fread(magic, 1, 4, file) == 4 &&
+              std::memcmp(magic, "WCAM", 4) == 0 &&
+              std::fread(&version, sizeof(uint32_t), 1, file) == 1 &&
+              version == CAMERA_PATH_VERSION &&
+              std::fread(&frames, sizeof(uint32_t), 1, file) == 1;
+    if (ok) {
+        samples.resize(frames);
+        ok = std::fread(samples.data(), sizeof(CameraSample), frames, file) ==
+             frames;
+    }
+    std::fclose(file);
+    if (!ok) {
+        std::printf("camera path: %s isn't a version %u recording\n",
+                    path.c_str(), CAMERA_PATH_VERSION);
+    }
+    return ok;
+}
+
+void ApplyCameraSample(const CameraSample &sample, Camera &camera) {
+    camera.cameraPos =
+        glm::vec3(sample.position[0], sample.position[1], sample.position[2]);
+    camera.cameraFront = glm::normalize(
+        glm::vec3(sample.front[0], sample.front[1], sample.front[2]));
+    camera.fov = sample.fov;
+    camera.zFar = sample.zFar;
+
+    // yaw/pitch from front, so mouse look would carry on from here
+    camera.pitch = glm::degrees(std::asin(camera.cameraFront.y));
+    camera.yaw =
+        glm::degrees(std::atan2(camera.cameraFront.z, camera.cameraFront.x));
+    camera.cameraRight =
+        glm::normalize(glm::cross(camera.cameraFront, camera.cameraUp));
+    camera.frustum = createFrustumFromCamera(camera);
+}
+
+#endif // CAMERAPATH_H
@@ -1,10 +1,19 @@
 #ifndef CHUNK_H
 #define CHUNK_H
 #include "Block.h"
+#include "MemoryStats.h"
+#include "ChunkLod.h"
 #include "ChunkMesh.h"
+#include "ChunkVisibility.h"
+#include "OcclusionCulling.h"
+#include "Profiler.h"
 #include "TerrainGenerator.h"
+#include "ChunkIO.h"
+#include "MeshCache.h"
+#include "WorldStorage.h"
 #include <glm/glm.hpp>
 #include <learnopengl/shader_m.h>
+#include <vector>
 
 /*
         TODO LIST:
@@ -19,6 +28,20 @@ typedef struct VoxelPoint3D {
     int z;
 } VoxelPoint3d;
 
+struct ChunkNeighbourhood;
+
+// the block grid a mesh is built from: the chunk's own blocks, or a
+// downsampled copy for far chunks (see ChunkLod.h)
+struct MeshGrid {
+    const Block *blocks;
+    int size;     // cells per side
+    int cellSize; // blocks per cell side
+
+    inline const Block &get(int x, int y, int z) const {
+        return blocks[x + y * size + z * size * size];
+    }
+};
+
 struct Chunk {
     static constexpr int CHUNK_SIZE = 16;
     static constexpr int CHUNK_SIZE_CUBED =
@@ -26,27 +49,71 @@ struct Chunk {
     static bool debugMode;
 
     Block blocks[CHUNK_SIZE_CUBED] = {Block()};
-    ChunkMesh mesh;
+    ChunkMesh mesh = {};            // opaque blocks
+    ChunkMesh translucentMesh = {}; // water, drawn after all opaque meshes
     // ChunkModel model;
     glm::vec3 chunkPosition; // minimum corner of the chunk
     Material material;
 
+    bool queuedForRebuild = false; // in ChunkManager::chunkRebuildList
+    // blocks differ from the saved ones (or were never saved), see
+    // WorldStorage.h
+    bool unsaved = false;
+    int lodLevel = 0;              // level the current mesh was built at
+    int targetLodLevel = 0;        // level picked from the camera distance
+    // which faces see each other through air, see ChunkVisibility.h
+    uint64_t faceConnectivity = ALL_FACES_CONNECTED;
+    // solid block layers from the bottom, used as an occluder
+    int solidLayers = 0;
+
+    // render queue bookkeeping, see RenderQueue.h
+    unsigned int visibleFrame = 0;
+    unsigned int queuedFrame[2] = {0, 0};
+
     Chunk(glm::vec3 position, Shader *shader);
     ~Chunk();
 
-    void createMesh();
+    // cache (if any) is asked for the mesh first, see MeshCache.h
+    void createMesh(const ChunkNeighbourhood &neighbourhood,
+                    MeshCache *cache = nullptr);
+    void buildMesh(const ChunkNeighbourhood &neighbourhood,
+                   MeshCache *cache = nullptr);
+    // hash of everything buildMesh reads at targetLodLevel
+    uint64_t meshKey(const ChunkNeighbourhood &neighbourhood) const;
+    void uploadMesh();
     void load();
-    void unload();
-    void rebuildMesh();
-    void setup(TerrainGenerator *generator);
-    void render(Camera camera);
+    // drops the mesh and blocks, unsaved blocks are queued on io first
+    void unload(ChunkIO *io = nullptr);
+    void rebuildMesh(const ChunkNeighbourhood &neighbourhood,
+                     MeshCache *cache = nullptr);
+    void generate(TerrainGenerator *generator);
+    // generate for all of chunks with one TerrainGenerator::generateChunks,
+    // chunks saved in io's storage (if any) are loaded instead
+    static void generateBatch(const std::vector<Chunk *> &chunks,
+                              TerrainGenerator *generator, ChunkIO *io = nullptr);
+    // straight to storage on this thread, ChunkIO does it on its own
+    bool loadFrom(WorldStorage &storage);
+    bool saveTo(WorldStorage &storage);
+    // chunk coordinates in storage, the generator's in chunks
+    glm::ivec3 storageCoords() const;
+    void setup(const ChunkNeighbourhood &neighbourhood,
+               MeshCache *cache = nullptr);
+    // the rest of setup for a mesh already built (buildMesh, any thread),
+    // uploading is GL so this is for the render thread
+    void finishSetup(bool upload = true);
+    void render(Camera camera, bool translucent);
+    bool hasOpaque();
+    bool hasTranslucent();
     // BoundingBox getBoundingBox();
     void initialize(TerrainGenerator *generator);
+    glm::vec3 generatorPosition() const;
     void AddCubeFace(ChunkMesh *mesh, int p1, int p2, int p3, int p4,
-                     int *vCount, int *iCount);
-    void CreateCube(ChunkMesh *mesh, int blockX, int blockY, int blockZ,
-                    float size, int *vCount, int *iCount);
+                     bool flip, int *vCount, int *iCount);
+    void CreateCube(ChunkMesh *mesh, const ChunkNeighbourhood &neighbourhood,
+                    const MeshGrid &grid, int blockX, int blockY, int blockZ,
+                    int *vCount, int *iCount);
     bool isLoaded();
+    bool isGenerated();
     bool isSetup();
 
     inline int getIndex(int x, int y, int z) const {
@@ -70,39 +137,61 @@ struct Chunk {
     // }
 
 
-    // u/v represent texture coordinate / size
+    // x, y, z are block corners within the chunk, 0-16, the shader scales
+    // them by BLOCK_RENDER_SIZE
     // normal is just face number, 0-5
-    // x, y, z are 0-63, SUPPORTS 63x63 TEXTURES, due to coordinate system
-    inline int packVertex(int x, int y, int z, int normal, int u, int v) {
-        int offset = 16; // Offset to handle negative values
-        return ((x + offset) & 0x3F) |              // 6 bits for x
-               (((y + offset) & 0x3F) << 6) |       // 6 bits for y
-               (((z + offset) & 0x3F) << 12) |      // 6 bits for z
-               ((normal & 0x7) << 18) |             // 3 bits for normal
-               ((u & 0x1F) << 21) |               // 5 bits for u (x)
-               ((v & 0x1F) << 26);                // 5 bits for v (y)
+    // u/v represent texture coordinate / size, SUPPORTS 31x31 TEXTURES
+    // ao is the ambient occlusion level of the corner, 0 (dark) - 3 (lit)
+    inline int packVertex(int x, int y, int z, int normal, int u, int v,
+                          int ao) {
+        return (x & 0x1F) |                 // 5 bits for x
+               ((y & 0x1F) << 5) |          // 5 bits for y
+               ((z & 0x1F) << 10) |         // 5 bits for z
+               ((normal & 0x7) << 15) |     // 3 bits for normal
+               ((u & 0x1F) << 18) |         // 5 bits for u (x)
+               ((v & 0x1F) << 23) |         // 5 bits for v (y)
+               ((ao & 0x3) << 28);          // 2 bits for ambient occlusion
     }
 
-    // update just the texture coordinates while maintaining the same vertex 
-    inline int updateTexCoords(int packedVertex, int normal, int u, int v) {
-        // Clear bits 18–26 (normal, u/texX and v/texY)
-        int cleared = packedVertex & ~(0x7 << 18) & ~(0x1F << 21) & ~(0x1F << 26);
-    
-        // Set new 
-        cleared |= (normal & 0x7) << 18;
-        cleared |= (u & 0x1F) << 21;
-        cleared |= (v & 0x1F) << 26;
-    
-        return cleared;
-    }
-    
-    
-
   private:
     bool loaded;
+    bool generated;
     bool hasSetup;
 };
 
+/*
+    The 3x3x3 block arrays around a chunk (the chunk itself in the middle),
+    so the mesher can look at blocks across chunk borders.
+    Neighbours that don't exist or aren't generated yet are nullptr and
+    count as air.
+*/
+struct ChunkNeighbourhood {
+    const Block *blocks[27] = {nullptr};
+
+    // x, y, z are relative to the middle chunk, -CHUNK_SIZE to
+    // 2 * CHUNK_SIZE - 1
+    inline const Block *getBlock(int x, int y, int z) const {
+        constexpr int size = Chunk::CHUNK_SIZE;
+        int cx = x < 0 ? 0 : (x < size ? 1 : 2);
+        int cy = y < 0 ? 0 : (y < size ? 1 : 2);
+        int cz = z < 0 ? 0 : (z < size ? 1 : 2);
+        const Block *chunkBlocks = blocks[cx + cy * 3 + cz * 9];
+        if (chunkBlocks == nullptr) {
+            return nullptr;
+        }
+        x -= (cx - 1) * size;
+        y -= (cy - 1) * size;
+        z -= (cz - 1) * size;
+        return &chunkBlocks[x + y * size + z * size * size];
+    }
+
+    // does the block at x, y, z darken the corners next to it
+    inline bool isOccluder(int x, int y, int z) const {
+        const Block *block = getBlock(x, y, z);
+        return block != nullptr && block->isActive && !block->isTranslucent();
+    }
+};
+
 bool Chunk::debugMode = false;
 
 Chunk::Chunk(glm::vec3 position, Shader *shader) {
@@ -113,71 +202,271 @@ Chunk::Chunk(glm::vec3 position, Shader *shader) {
     // material.maps[MATERIAL_MAP_DIFFUSE].color.a = 255.0f;
 
     hasSetup = false;
+    generated = false;
     loaded = false;
+    MemoryStats::add(MEM_CHUNK_BLOCKS, sizeof(blocks));
 };
 
 Chunk::~Chunk(){
     // delete blocks;
+    MemoryStats::remove(MEM_CHUNK_BLOCKS, sizeof(blocks));
 };
 
-// create vbo to be used to render chunk
-void Chunk::createMesh() {
-    int vertexCount = 0;
-    int indexCount = 0;
+// allocate room for the faces of blockCount blocks
+static void AllocateChunkMesh(ChunkMesh *mesh, int blockCount) {
+    *mesh = {0};
+    mesh->vertexCount = 0;
+    mesh->triangleCount = 0;
+    if (blockCount == 0) {
+        mesh->vertices = NULL;
+        mesh->indices = NULL;
+        return;
+    }
+    mesh->vertices = (int *)malloc(blockCount * 6 * 4 * sizeof(int));
+    mesh->indices =
+        (unsigned int *)malloc(blockCount * 6 * 6 * sizeof(unsigned int));
+    mesh->cpuBytes = blockCount * 6 * (4 * sizeof(int) + 6 * sizeof(unsigned int));
+    MemoryStats::add(MEM_MESH_CPU, mesh->cpuBytes);
+}
+
+// create vbos to be used to render chunk
+void Chunk::createMesh(const ChunkNeighbourhood &neighbourhood,
+                       MeshCache *cache) {
+    buildMesh(neighbourhood, cache);
+    uploadMesh();
+}
+
+// fill the CPU side vertex/index arrays, no GL calls so it can run without a
+// context (voxel-bench)
+// opaque and translucent (water) blocks go into separate meshes so the
+// opaque one can be drawn without blending
+// far chunks are meshed from a downsampled grid, see ChunkLod.h
+void Chunk::buildMesh(const ChunkNeighbourhood &neighbourhood,
+                      MeshCache *cache) {
+    PROFILE_SCOPE("mesh");
+    int opaqueIndexCount = 0;
+    int translucentIndexCount = 0;
+
+    lodLevel = targetLodLevel;
+    uint64_t key = 0;
+    if (cache != nullptr) {
+        key = meshKey(neighbourhood);
+        if (cache->get(key, mesh, translucentMesh, faceConnectivity,
+                       solidLayers)) {
+            return;
+        }
+    }
 
-    int totalVertices = CHUNK_SIZE_CUBED * 6 * 4 * 2;
-    int totalIndices = CHUNK_SIZE_CUBED * 6 * 6 * 2;
+    faceConnectivity = ComputeFaceConnectivity(blocks, CHUNK_SIZE);
+    solidLayers = SolidLayersFromBottom(blocks, CHUNK_SIZE);
 
-    unsigned int *indices =
-        (unsigned int *)malloc(totalIndices * sizeof(unsigned int));
+    MeshGrid grid = {blocks, CHUNK_SIZE, 1};
+    Block lodBlocks[CHUNK_SIZE_CUBED / 8];
+    if (lodLevel > 0) {
+        DownsampleBlocks(blocks, CHUNK_SIZE, lodLevel, lodBlocks);
+        grid = {lodBlocks, CHUNK_SIZE >> lodLevel, 1 << lodLevel};
+    }
+    int cellCount = grid.size * grid.size * grid.size;
+
+    // count blocks first so each mesh is only as big as it needs to be
+    int opaqueBlocks = 0;
+    int translucentBlocks = 0;
+    for (int i = 0; i < cellCount; i++) {
+        if (!grid.blocks[i].isActive) {
+            continue;
+        }
+        if (grid.blocks[i].isTranslucent()) {
+            translucentBlocks++;
+        } else {
+            opaqueBlocks++;
+        }
+    }
 
-    mesh = {0};
-    mesh.vertexCount = 0;
-    mesh.triangleCount = 0;
-    mesh.vertices = (int *)malloc(totalVertices * sizeof(int));
-    mesh.indices = indices;
+    AllocateChunkMesh(&mesh, opaqueBlocks);
+    AllocateChunkMesh(&translucentMesh, translucentBlocks);
 
-    for (int x = 0; x < CHUNK_SIZE; x++) {
-        for (int y = 0; y < CHUNK_SIZE; y++) {
-            for (int z = 0; z < CHUNK_SIZE; z++) {
-                Block &block = blocks[getIndex(x, y, z)];
+    for (int x = 0; x < grid.size; x++) {
+        for (int y = 0; y < grid.size; y++) {
+            for (int z = 0; z < grid.size; z++) {
+                const Block &block = grid.get(x, y, z);
                 if (!block.isActive) {
                     continue;
                 }
-                CreateCube(&mesh, x, y, z, Block::BLOCK_RENDER_SIZE,
-                           &mesh.vertexCount, &indexCount);
+                if (block.isTranslucent()) {
+                    CreateCube(&translucentMesh, neighbourhood, grid, x, y, z,
+                               &translucentMesh.vertexCount,
+                               &translucentIndexCount);
+                } else {
+                    CreateCube(&mesh, neighbourhood, grid, x, y, z,
+                               &mesh.vertexCount, &opaqueIndexCount);
+                }
             }
         }
     }
 
-    mesh.triangleCount = indexCount / 3;
-    UploadChunkMesh(&mesh, false);
+    mesh.triangleCount = opaqueIndexCount / 3;
+    translucentMesh.triangleCount = translucentIndexCount / 3;
+
+    if (cache != nullptr) {
+        cache->put(key, mesh, translucentMesh, faceConnectivity, solidLayers);
+    }
+}
+
+// the block values, the level of detail and, at full detail, which blocks
+// in the 1 block shell around the chunk darken corners (ambient occlusion
+// is the only thing the mesher looks across the border for). Texture
+// coordinates aren't in it, MESH_CACHE_VERSION covers those
+uint64_t Chunk::meshKey(const ChunkNeighbourhood &neighbourhood) const {
+    constexpr int SHELL = (CHUNK_SIZE + 2) * (CHUNK_SIZE + 2) * (CHUNK_SIZE + 2) -
+                          CHUNK_SIZE_CUBED;
+    uint8_t bytes[CHUNK_SIZE_CUBED + 1 + (SHELL + 7) / 8] = {0};
+    for (int i = 0; i < CHUNK_SIZE_CUBED; i++) {
+        bytes[i] = chunkCodecValue(blocks[i]);
+    }
+    bytes[CHUNK_SIZE_CUBED] = (uint8_t)targetLodLevel;
+    size_t size = CHUNK_SIZE_CUBED + 1;
+    if (targetLodLevel == 0) {
+        uint8_t *shell = bytes + size;
+        int bit = 0;
+        for (int z = -1; z <= CHUNK_SIZE; z++) {
+            for (int y = -1; y <= CHUNK_SIZE; y++) {
+                // rows through the chunk only have their two ends outside
+                bool inside = z >= 0 && z < CHUNK_SIZE && y >= 0 && y < CHUNK_SIZE;
+                int step = inside ? CHUNK_SIZE + 1 : 1;
+                for (int x = -1; x <= CHUNK_SIZE; x += step, bit++) {
+                    if (neighbourhood.isOccluder(x, y, z)) {
+                        shell[bit >> 3] |= (uint8_t)(1 << (bit & 7));
+                    }
+                }
+            }
+        }
+        size += (SHELL + 7) / 8;
+    }
+    return Hash64(bytes, size, MESH_CACHE_VERSION);
+}
+
+void Chunk::uploadMesh() {
+    PROFILE_SCOPE("upload");
+    if (hasOpaque()) {
+        UploadChunkMesh(&mesh, false);
+    }
+    if (hasTranslucent()) {
+        UploadChunkMesh(&translucentMesh, false);
+    }
     // model = LoadChunkModelFromMesh(mesh, material);
     // model = LoadModelFromMesh(mesh);
 }
 
 void Chunk::load() { loaded = true; }
 
-void Chunk::unload() {
+void Chunk::unload(ChunkIO *io) {
+    if (io != nullptr && generated && unsaved) {
+        io->save(storageCoords(), blocks);
+        unsaved = false;
+    }
     // UnloadModel(model);
     UnloadChunkMesh(mesh);
+    UnloadChunkMesh(translucentMesh);
     loaded = false;
+    generated = false;
     hasSetup = false;
 }
 
-void Chunk::rebuildMesh() {
+void Chunk::rebuildMesh(const ChunkNeighbourhood &neighbourhood,
+                        MeshCache *cache) {
     UnloadChunkMesh(mesh);
-    createMesh();
+    UnloadChunkMesh(translucentMesh);
+    createMesh(neighbourhood, cache);
 }
 
-void Chunk::setup(TerrainGenerator *generator) {
+// fills the blocks, meshing waits until the neighbours are generated too
+void Chunk::generate(TerrainGenerator *generator) {
+    PROFILE_SCOPE("generate");
     initialize(generator);
-    createMesh();
+    generated = true;
+    unsaved = true;
+}
+
+void Chunk::generateBatch(const std::vector<Chunk *> &chunks,
+                          TerrainGenerator *generator, ChunkIO *io) {
+    PROFILE_SCOPE("generate");
+    // saved chunks are whatever was saved, the generator isn't asked
+    std::vector<ChunkIO::LoadRequest> saved;
+    if (io != nullptr) {
+        saved.reserve(chunks.size());
+        for (Chunk *chunk : chunks) {
+            saved.push_back({chunk->storageCoords(), chunk->blocks});
+        }
+        io->load(saved);
+    }
+
+    std::vector<glm::vec3> positions;
+    std::vector<Block *> blocks;
+    positions.reserve(chunks.size());
+    blocks.reserve(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        Chunk *chunk = chunks[i];
+        if (io != nullptr && saved[i].found) {
+            chunk->unsaved = false;
+            continue;
+        }
+        chunk->unsaved = true;
+        // all air or all solid chunks don't need the generator
+        if (!generator->generateFromBounds(chunk->generatorPosition(),
+                                           chunk->blocks)) {
+            positions.push_back(chunk->generatorPosition());
+            blocks.push_back(chunk->blocks);
+        }
+    }
+    generator->generateChunks(positions, blocks);
+    for (Chunk *chunk : chunks) {
+        chunk->generated = true;
+    }
+}
+
+glm::ivec3 Chunk::storageCoords() const {
+    return glm::ivec3(glm::floor(generatorPosition() / (float)CHUNK_SIZE));
+}
+
+bool Chunk::loadFrom(WorldStorage &storage) {
+    glm::ivec3 coords = storageCoords();
+    if (!storage.loadChunk(coords.x, coords.y, coords.z, blocks, CHUNK_SIZE_CUBED)) {
+        return false;
+    }
+    unsaved = false;
+    return true;
+}
+
+bool Chunk::saveTo(WorldStorage &storage) {
+    glm::ivec3 coords = storageCoords();
+    if (!storage.saveChunk(coords.x, coords.y, coords.z, blocks, CHUNK_SIZE_CUBED)) {
+        return false;
+    }
+    unsaved = false;
+    return true;
+}
+
+void Chunk::setup(const ChunkNeighbourhood &neighbourhood, MeshCache *cache) {
+    createMesh(neighbourhood, cache);
     hasSetup = true;
 }
 
-// renders the chunk
-void Chunk::render(Camera camera) { DrawChunkMesh(camera, mesh, material, chunkPosition); }
+void Chunk::finishSetup(bool upload) {
+    if (upload) {
+        uploadMesh();
+    }
+    hasSetup = true;
+}
+
+// renders either the opaque or the translucent part of the chunk
+void Chunk::render(Camera camera, bool translucent) {
+    DrawChunkMesh(camera, translucent ? translucentMesh : mesh, material,
+                  chunkPosition);
+}
+
+bool Chunk::hasOpaque() { return mesh.triangleCount > 0; }
+
+bool Chunk::hasTranslucent() { return translucentMesh.triangleCount > 0; }
 
 // BoundingBox Chunk::getBoundingBox() {
 //     glm::vec3 max = {chunkPosition.x + CHUNK_SIZE * Block::BLOCK_RENDER_SIZE,
@@ -191,22 +480,29 @@ void Chunk::render(Camera camera) { DrawChunkMesh(camera, mesh, material, chunkP
 // TODO: use a terrain generator 
 
 void Chunk::initialize(TerrainGenerator *generator) {
+    if (!generator->generateFromBounds(generatorPosition(), blocks)) {
+        generator->generateChunk(generatorPosition(), blocks);
+    }
+}
+
+glm::vec3 Chunk::generatorPosition() const {
     // normalise chunk position from real world position to 
     // index in grid position for perlin noise based generation
 
     // divide by block render size
-    generator->generateChunk(glm::vec3{
+    return glm::vec3{
         chunkPosition.x / Block::BLOCK_RENDER_SIZE,
         chunkPosition.y / Block::BLOCK_RENDER_SIZE,
         chunkPosition.z / Block::BLOCK_RENDER_SIZE
-    }, blocks);
+    };
 }
 
 // void deactivateBlock(Vector2 coords) {
 // }
 
+// flip picks the p2-p4 diagonal instead of p1-p3 to split the quad
 void Chunk::AddCubeFace(ChunkMesh *mesh, int p1, int p2, int p3, int p4,
-                        int *vCount, int *iCount) {
+                        bool flip, int *vCount, int *iCount) {
     int v1 = *vCount;
     int v2 = *vCount + 1;
     int v3 = *vCount + 2;
@@ -219,87 +515,74 @@ void Chunk::AddCubeFace(ChunkMesh *mesh, int p1, int p2, int p3, int p4,
     mesh->vertices[v4] = p4;
 
     // Add indices
-    mesh->indices[*iCount] = v1;
-    mesh->indices[*iCount + 1] = v2;
-    mesh->indices[*iCount + 2] = v3;
-    mesh->indices[*iCount + 3] = v1;
-    mesh->indices[*iCount + 4] = v3;
-    mesh->indices[*iCount + 5] = v4;
+    if (flip) {
+        mesh->indices[*iCount] = v2;
+        mesh->indices[*iCount + 1] = v3;
+        mesh->indices[*iCount + 2] = v4;
+        mesh->indices[*iCount + 3] = v2;
+        mesh->indices[*iCount + 4] = v4;
+        mesh->indices[*iCount + 5] = v1;
+    } else {
+        mesh->indices[*iCount] = v1;
+        mesh->indices[*iCount + 1] = v2;
+        mesh->indices[*iCount + 2] = v3;
+        mesh->indices[*iCount + 3] = v1;
+        mesh->indices[*iCount + 4] = v3;
+        mesh->indices[*iCount + 5] = v4;
+    }
 
     *vCount += 4;
     *iCount += 6;
 }
 
-void Chunk::CreateCube(ChunkMesh *mesh, int blockX, int blockY, int blockZ,
-                       float size, int *vCount, int *iCount) {
-    int hs = (int)(size / 2.0f);
-
-    // TODO: casts here?
-    // TODO: ignore normals for now
-
-
-    // DEFINES THE 8 POINTS OF THE CUBE
-    // NEED TO CHANGE BLOCKTYPE to x and y coords for map
-
-    BlockType blockType = blocks[getIndex(blockX, blockY, blockZ)].blockType;
-    // packvertex(int x, int y, int z, int normal, int tex_x, int tex_y)
-    // set texture coordinates to 0,0 for now, change according to face
-    int p1 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX - hs,
-                               Block::BLOCK_RENDER_SIZE * blockY - hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ + hs, 1,
-                               0, 0);
-    int p2 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX + hs,
-                               Block::BLOCK_RENDER_SIZE * blockY - hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ + hs, 1,
-                               0, 0);
-    int p3 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX + hs,
-                               Block::BLOCK_RENDER_SIZE * blockY + hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ + hs, 1,
-                               0, 0);
-    int p4 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX - hs,
-                               Block::BLOCK_RENDER_SIZE * blockY + hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ + hs, 1,
-                               0, 0);
-    int p5 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX + hs,
-                               Block::BLOCK_RENDER_SIZE * blockY - hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ - hs, 1,
-                               0, 0);
-    int p6 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX - hs,
-                               Block::BLOCK_RENDER_SIZE * blockY - hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ - hs, 1,
-                               0, 0);
-    int p7 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX - hs,
-                               Block::BLOCK_RENDER_SIZE * blockY + hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ - hs, 1,
-                               0, 0);
-    int p8 = Chunk::packVertex(Block::BLOCK_RENDER_SIZE * blockX + hs,
-                               Block::BLOCK_RENDER_SIZE * blockY + hs,
-                               Block::BLOCK_RENDER_SIZE * blockZ - hs, 1,
-                               0, 0);
-
-    
-    // CHECKS FOR NEIGHBORING BLOCKS
+/*
+    Faces of a cube, in textureCoordMap order:
+    front, back, left, right, top, bottom
+    corner: offset of each of the 4 vertices from the block's minimum corner
+    uv: texture corner of each vertex
+*/
+struct CubeFace {
+    int dir[3];
+    int corner[4][3];
+    int uv[4][2];
+};
+
+static const CubeFace CUBE_FACES[6] = {
+    {{0, 0, 1}, {{0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}},
+     {{0, 1}, {1, 1}, {1, 0}, {0, 0}}},
+    {{0, 0, -1}, {{1, 0, 0}, {0, 0, 0}, {0, 1, 0}, {1, 1, 0}},
+     {{0, 1}, {1, 1}, {1, 0}, {0, 0}}},
+    {{1, 0, 0}, {{1, 0, 1}, {1, 0, 0}, {1, 1, 0}, {1, 1, 1}},
+     {{0, 1}, {1, 1}, {1, 0}, {0, 0}}},
+    {{-1, 0, 0}, {{0, 0, 0}, {0, 0, 1}, {0, 1, 1}, {0, 1, 0}},
+     {{0, 1}, {1, 1}, {1, 0}, {0, 0}}},
+    {{0, 1, 0}, {{0, 1, 1}, {1, 1, 1}, {1, 1, 0}, {0, 1, 0}},
+     {{0, 0}, {1, 0}, {1, 1}, {0, 1}}},
+    {{0, -1, 0}, {{0, 0, 0}, {1, 0, 0}, {1, 0, 1}, {0, 0, 1}},
+     {{0, 0}, {1, 0}, {1, 1}, {0, 1}}},
+};
 
-    bool lDefault = false;
-    bool lXNegative = lDefault;
-    if (blockX > 0)
-        lXNegative = blocks[getIndex(blockX - 1, blockY, blockZ)].isActive;
-    bool lXPositive = lDefault;
-    if (blockX < CHUNK_SIZE - 1)
-        lXPositive = blocks[getIndex(blockX + 1, blockY, blockZ)].isActive;
-    bool lYNegative = lDefault;
-    if (blockY > 0)
-        lYNegative = blocks[getIndex(blockX, blockY - 1, blockZ)].isActive;
-    bool lYPositive = lDefault;
-    if (blockY < CHUNK_SIZE - 1)
-        lYPositive = blocks[getIndex(blockX, blockY + 1, blockZ)].isActive;
-    bool lZNegative = lDefault;
-    if (blockZ > 0)
-        lZNegative = blocks[getIndex(blockX, blockY, blockZ - 1)].isActive;
-    bool lZPositive = lDefault;
-    if (blockZ < CHUNK_SIZE - 1)
-        lZPositive = blocks[getIndex(blockX, blockY, blockZ + 1)].isActive;
+// blockX, blockY, blockZ are cell coordinates in the grid, which are
+// block coordinates unless the chunk is meshed at a lower level of detail
+void Chunk::CreateCube(ChunkMesh *mesh, const ChunkNeighbourhood &neighbourhood,
+                       const MeshGrid &grid, int blockX, int blockY,
+                       int blockZ, int *vCount, int *iCount) {
+    BlockType blockType = grid.get(blockX, blockY, blockZ).blockType;
 
+    // CHECKS FOR NEIGHBORING BLOCKS
+    // a face is hidden by an opaque neighbour, water faces are also hidden
+    // by neighbouring water so only the surface of a body of water is meshed
+    // faces on the chunk border are always added
+
+    bool translucent = grid.get(blockX, blockY, blockZ).isTranslucent();
+    auto hides = [&](int x, int y, int z) {
+        if (x < 0 || x >= grid.size || y < 0 || y >= grid.size || z < 0 ||
+            z >= grid.size) {
+            return false;
+        }
+        const Block &neighbour = grid.get(x, y, z);
+        return neighbour.isActive && (!neighbour.isTranslucent() || translucent);
+    };
 
     // ADD TRIANGLES INTO MESH
     // prevent segfault if block does not exist
@@ -308,74 +591,67 @@ void Chunk::CreateCube(ChunkMesh *mesh, int blockX, int blockY, int blockZ,
         exit(1);
     }
 
-    std::vector<std::pair<int, int>> textureCoords = textureCoordMap[blockType];
-    // front, back, left, right, top, bottom
-
-    glm::vec3 n1;       // for normal??, not used. 
-    // front face
-    if (!lZPositive) {
-        n1 = {0.0f, 0.0f, 1.0f};
-        p1 = updateTexCoords(p1, 0, textureCoords[0].first, textureCoords[0].second + 1);
-        p2 = updateTexCoords(p2, 0, textureCoords[0].first + 1, textureCoords[0].second + 1);
-        p3 = updateTexCoords(p3, 0, textureCoords[0].first + 1, textureCoords[0].second);
-        p4 = updateTexCoords(p4, 0, textureCoords[0].first, textureCoords[0].second);
-        
-        AddCubeFace(mesh, p1, p2, p3, p4, vCount, iCount);
-    }
-
-    // back face
-    if (!lZNegative) {
-        n1 = {0.0f, 0.0f, -1.0f};
-        p5 = updateTexCoords(p5, 1, textureCoords[1].first, textureCoords[1].second + 1);
-        p6 = updateTexCoords(p6, 1, textureCoords[1].first + 1, textureCoords[1].second + 1);
-        p7 = updateTexCoords(p7, 1, textureCoords[1].first + 1, textureCoords[1].second);
-        p8 = updateTexCoords(p8, 1, textureCoords[1].first, textureCoords[1].second);
-        AddCubeFace(mesh, p5, p6, p7, p8, vCount, iCount);
-    }
+    std::vector<std::pair<int, int>> &textureCoords = textureCoordMap[blockType];
 
-    // left face
-    if (!lXPositive) {
-        n1 = {1.0f, 0.0f, 0.0f};
-        p2 = updateTexCoords(p2, 2, textureCoords[2].first, textureCoords[2].second + 1);
-        p5 = updateTexCoords(p5, 2, textureCoords[2].first + 1, textureCoords[2].second + 1);
-        p8 = updateTexCoords(p8, 2, textureCoords[2].first + 1, textureCoords[2].second);
-        p3 = updateTexCoords(p3, 2, textureCoords[2].first, textureCoords[2].second);
-        AddCubeFace(mesh, p2, p5, p8, p3, vCount, iCount);
-    }
+    for (int face = 0; face < 6; face++) {
+        const CubeFace &f = CUBE_FACES[face];
+        int nx = blockX + f.dir[0];
+        int ny = blockY + f.dir[1];
+        int nz = blockZ + f.dir[2];
+        if (hides(nx, ny, nz)) {
+            continue;
+        }
 
-    // right face
-    if (!lXNegative) {
-        n1 = {-1.0f, 0.0f, 0.0f};
-        p6 = updateTexCoords(p6, 3, textureCoords[3].first, textureCoords[3].second + 1);
-        p1 = updateTexCoords(p1, 3, textureCoords[3].first + 1, textureCoords[3].second + 1);
-        p4 = updateTexCoords(p4, 3, textureCoords[3].first + 1, textureCoords[3].second);
-        p7 = updateTexCoords(p7, 3, textureCoords[3].first, textureCoords[3].second);
-        AddCubeFace(mesh, p6, p1, p4, p7, vCount, iCount);
-    }
+        int packed[4];
+        int ao[4];
+        for (int v = 0; v < 4; v++) {
+            const int *c = f.corner[v];
+
+            // ambient occlusion from the 3 blocks touching this corner in
+            // front of the face: 2 sides and the diagonal between them.
+            // water and far chunks are not shaded
+            ao[v] = 3;
+            if (!translucent && grid.cellSize == 1) {
+                int side[2][3];
+                int s = 0;
+                for (int axis = 0; axis < 3; axis++) {
+                    if (f.dir[axis] != 0) {
+                        continue;
+                    }
+                    side[s][0] = side[s][1] = side[s][2] = 0;
+                    side[s][axis] = c[axis] ? 1 : -1;
+                    s++;
+                }
+                bool side1 = neighbourhood.isOccluder(
+                    nx + side[0][0], ny + side[0][1], nz + side[0][2]);
+                bool side2 = neighbourhood.isOccluder(
+                    nx + side[1][0], ny + side[1][1], nz + side[1][2]);
+                bool corner = neighbourhood.isOccluder(
+                    nx + side[0][0] + side[1][0], ny + side[0][1] + side[1][1],
+                    nz + side[0][2] + side[1][2]);
+                ao[v] = (side1 && side2) ? 0 : 3 - (side1 + side2 + corner);
+            }
 
-    // top face
-    if (!lYPositive) {
-        n1 = {0.0f, 1.0f, 0.0f};
-        p4 = updateTexCoords(p4, 4, textureCoords[4].first, textureCoords[4].second);
-        p3 = updateTexCoords(p3, 4, textureCoords[4].first + 1, textureCoords[4].second);
-        p8 = updateTexCoords(p8, 4, textureCoords[4].first + 1, textureCoords[4].second + 1);
-        p7 = updateTexCoords(p7, 4, textureCoords[4].first, textureCoords[4].second + 1);
-        AddCubeFace(mesh, p4, p3, p8, p7, vCount, iCount);
-    }
+            packed[v] = packVertex(
+                (blockX + c[0]) * grid.cellSize,
+                (blockY + c[1]) * grid.cellSize,
+                (blockZ + c[2]) * grid.cellSize, face,
+                textureCoords[face].first + f.uv[v][0],
+                textureCoords[face].second + f.uv[v][1], ao[v]);
+        }
 
-    // bottom face
-    if (!lYNegative) {
-        n1 = {0.0f, -1.0f, 0.0f};
-        p6 = updateTexCoords(p6, 5, textureCoords[5].first, textureCoords[5].second);
-        p5 = updateTexCoords(p5, 5, textureCoords[5].first + 1, textureCoords[5].second);
-        p2 = updateTexCoords(p2, 5, textureCoords[5].first + 1, textureCoords[5].second + 1);
-        p1 = updateTexCoords(p1, 5, textureCoords[5].first, textureCoords[5].second + 1);
-        AddCubeFace(mesh, p6, p5, p2, p1, vCount, iCount);
+        // split the quad along the diagonal with the brighter corners so a
+        // single dark corner doesn't smear across the whole face
+        bool flip = ao[0] + ao[2] < ao[1] + ao[3];
+        AddCubeFace(mesh, packed[0], packed[1], packed[2], packed[3], flip,
+                    vCount, iCount);
     }
 }
 
 bool Chunk::isLoaded() { return loaded; }
 
+bool Chunk::isGenerated() { return generated; }
+
 bool Chunk::isSetup() { return hasSetup; }
 
 #endif // CHUNK_H
@@ -0,0 +1,147 @@
+#ifndef CHUNK_CODEC_H
+#define CHUNK_CODEC_H
+
+#include "Block.h"
+#include "Lz4.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+    A chunk's blocks as bytes for the region files (WorldStorage.h).
+
+    Each block is one value, 0 for air and 1 + blockType otherwise. The
+    values used make a palette (a handful per chunk), then the blocks in
+    index order are runs of palette entries:
+
+        palette count, palette values,
+        (palette index, run length - 1 as a varint) ...
+
+    Terrain is mostly long runs of the same block along x, so that's
+    usually a few hundred bytes. LZ4 goes on top for the layers that repeat
+    (the same run pattern row after row), and is dropped if it doesn't make
+    it smaller. Stored as
+
+        flags (CHUNK_CODEC_LZ4), raw size (2 bytes), raw or LZ4 bytes
+*/
+
+constexpr uint8_t CHUNK_CODEC_LZ4 = 1;
+
+static inline uint8_t chunkCodecValue(const Block &block) {
+    return block.isActive ? (uint8_t)(1 + block.blockType) : 0;
+}
+
+void EncodeChunk(const Block *blocks, int count, std::vector<uint8_t> &out) {
+    // values first, the palette and run scans below are then over bytes
+    thread_local std::vector<uint8_t> values;
+    values.resize(count);
+    bool used[256] = {false};
+    for (int i = 0; i < count; i++) {
+        values[i] = chunkCodecValue(blocks[i]);
+        used[values[i]] = true;
+    }
+    int paletteIndex[256];
+    std::vector<uint8_t> palette;
+    for (int value = 0; value < 256; value++) {
+        if (used[value]) {
+            paletteIndex[value] = (int)palette.size();
+            palette.push_back((uint8_t)value);
+        }
+    }
+
+    thread_local std::vector<uint8_t> raw;
+    raw.clear();
+    raw.push_back((uint8_t)palette.size());
+    raw.insert(raw.end(), palette.begin(), palette.end());
+    const uint8_t *value = values.data(), *end = value + count;
+    while (value < end) {
+        const uint8_t *run = value + 1;
+        while (run < end && *run == *value) {
+            run++;
+        }
+        raw.push_back((uint8_t)paletteIndex[*value]);
+        for (uint32_t length = (uint32_t)(run - value - 1);; length >>= 7) {
+            if (length < 0x80) {
+                raw.push_back((uint8_t)length);
+                break;
+            }
+            raw.push_back((uint8_t)(length | 0x80));
+        }
+        value = run;
+    }
+
+    out.resize(3 + Lz4CompressBound((int)raw.size()));
+    int compressed = Lz4Compress(raw.data(), (int)raw.size(), out.data() + 3,
+                                 (int)out.size() - 3);
+    bool useLz4 = compressed > 0 && compressed < (int)raw.size();
+    out[0] = useLz4 ? CHUNK_CODEC_LZ4 : 0;
+    out[1] = (uint8_t)(raw.size() & 0xFF);
+    out[2] = (uint8_t)(raw.size() >> 8);
+    if (useLz4) {
+        out.resize(3 + compressed);
+    } else {
+        out.resize(3);
+        out.insert(out.end(), raw.begin(), raw.end());
+    }
+}
+
+// false if data isn't a chunk of exactly count blocks, blocks is then
+// left half written
+bool DecodeChunk(const uint8_t *data, size_t size, Block *blocks, int count) {
+    if (size < 3) {
+        return false;
+    }
+    int rawSize = data[1] | (data[2] << 8);
+    std::vector<uint8_t> decompressed;
+    const uint8_t *raw = data + 3;
+    if (data[0] & CHUNK_CODEC_LZ4) {
+        decompressed.resize(rawSize);
+        if (Lz4Decompress(data + 3, (int)size - 3, decompressed.data(), rawSize) !=
+            rawSize) {
+            return false;
+        }
+        raw = decompressed.data();
+    } else if ((int)size - 3 != rawSize) {
+        return false;
+    }
+
+    const uint8_t *ip = raw, *end = raw + rawSize;
+    if (ip == end || end - ip < 1 + *ip) {
+        return false;
+    }
+    int paletteSize = *ip++;
+    const uint8_t *palette = ip;
+    ip += paletteSize;
+
+    int i = 0;
+    while (ip < end) {
+        int index = *ip++;
+        uint32_t length = 0;
+        for (int shift = 0;; shift += 7) {
+            if (ip == end || shift > 28) {
+                return false;
+            }
+            uint8_t byte = *ip++;
+            length |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (index >= paletteSize || length >= (uint32_t)(count - i)) {
+            return false;
+        }
+        uint8_t value = palette[index];
+        if (value > NumTypes) {
+            return false;
+        }
+        Block block;
+        block.isActive = value != 0;
+        block.blockType = value != 0 ? (BlockType)(value - 1) : BlockType::Default;
+        for (uint32_t n = 0; n <= length; n++) {
+            blocks[i++] = block;
+        }
+    }
+    return i == count;
+}
+
+#endif // CHUNK_CODEC_H
@@ -0,0 +1,459 @@
+#ifndef CHUNK_IO_H
+#define CHUNK_IO_H
+
+#include "Block.h"
+#include "ChunkCodec.h"
+#include "MemoryStats.h"
+#include "WorldStorage.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifdef VOXEL_IO_URING
+#include <liburing.h>
+#endif
+
+/*
+    Chunk reads and writes on their own thread, so neither the render
+    thread nor the generation workers wait on the disk for saves:
+
+        ChunkIO io(&storage, Chunk::CHUNK_SIZE_CUBED);
+        io.save(coords, blocks);   // encodes and returns, written later
+        io.load(requests);         // waits for its reads, served first
+        io.flush();                // everything saved so far is on disk
+
+    Saves are encoded (ChunkCodec.h) on the calling thread and queued, a
+    newer save of a chunk replaces the queued one (coalescing). The thread
+    writes the whole queue every flushInterval, as soon as it holds more
+    than MAX_QUEUED_BYTES, on flush() and when it's destroyed. Loads look
+    at the queue first, a chunk saved but not written yet comes back as
+    saved.
+
+    A batch of reads or writes is handed to io_uring all at once where the
+    build found liburing (VOXEL_IO_URING, see CMakeLists.txt) and the
+    kernel allows it, and done one pread/pwrite at a time otherwise.
+    Region table entries are written after their payloads either way, see
+    WorldStorage.h.
+*/
+
+class ChunkIO {
+  public:
+    static constexpr unsigned URING_DEPTH = 64;
+    static constexpr size_t MAX_QUEUED_BYTES = 4 << 20;
+
+    struct LoadRequest {
+        glm::ivec3 coords; // in chunks, see WorldStorage
+        Block *blocks;
+        bool found = false; // set by load()
+    };
+
+    // blockCount: blocks per chunk
+    ChunkIO(WorldStorage *storage, int blockCount,
+            std::chrono::milliseconds flushInterval = std::chrono::milliseconds(2000));
+    // writes what's queued, then stops the thread
+    ~ChunkIO();
+    ChunkIO(const ChunkIO &) = delete;
+    ChunkIO &operator=(const ChunkIO &) = delete;
+
+    void load(std::vector<LoadRequest> &requests);
+    void save(glm::ivec3 coords, const Block *blocks);
+    void flush();
+
+    // chunks waiting to be written and load batches waiting to be read
+    size_t queueDepth();
+    const char *backend() const;
+
+    // for stats and voxel-bench
+    std::atomic<uint64_t> chunksRead{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> chunksWritten{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> coalescedSaves{0}; // replaced before being written
+    std::atomic<uint64_t> flushes{0};
+
+  private:
+    using Key = std::tuple<int, int, int>;
+    struct LoadBatch {
+        std::vector<LoadRequest> *requests;
+        std::promise<void> done;
+    };
+    // one payload read or write of a batch
+    struct Transfer {
+        RegionFile *region;
+        int index;
+        RegionFile::Extent extent;
+        uint8_t *data;
+        bool ok;
+        bool inFlight = false; // taken by io_uring, no completion yet
+    };
+
+    WorldStorage *storage;
+    int blockCount;
+    std::chrono::milliseconds flushInterval;
+
+    std::mutex mutex;
+    std::condition_variable wake;    // the thread: loads, a flush or stop
+    std::condition_variable flushed; // flush(): a write of the queue finished
+    std::deque<LoadBatch *> loads;
+    std::map<Key, std::vector<uint8_t>> queued; // newest payload per chunk
+    size_t queuedBytes = 0;
+    uint64_t flushRequests = 0, flushesDone = 0;
+    bool stopping = false;
+
+#ifdef VOXEL_IO_URING
+    io_uring ring;
+    bool ringReady = false;
+#endif
+    std::thread thread; // last, everything above is set up when it starts
+
+    void run();
+    void serve(std::vector<LoadRequest> &requests);
+    void write(std::map<Key, std::vector<uint8_t>> &chunks);
+    // false if io_uring failed with transfers still in flight, their
+    // buffers then have to be stranded
+    bool transfer(std::vector<Transfer> &transfers, bool write);
+
+    // buffers io_uring may still read or write after the ring broke with
+    // requests in flight. The kernel never says when it's done with them,
+    // so they're never freed, not even by the destructor
+    std::vector<std::vector<uint8_t>> *stranded = nullptr;
+    void strand(std::vector<uint8_t> &&buffer);
+};
+
+ChunkIO::ChunkIO(WorldStorage *storage, int blockCount,
+                 std::chrono::milliseconds flushInterval)
+    : storage(storage), blockCount(blockCount), flushInterval(flushInterval) {
+#ifdef VOXEL_IO_URING
+    // fails on kernels without io_uring or where it's blocked, pread then
+    ringReady = io_uring_queue_init(URING_DEPTH, &ring, 0) == 0;
+#endif
+    thread = std::thread([this] { run(); });
+}
+
+ChunkIO::~ChunkIO() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+#ifdef VOXEL_IO_URING
+    if (ringReady) {
+        io_uring_queue_exit(&ring);
+    }
+#endif
+}
+
+const char *ChunkIO::backend() const {
+#ifdef VOXEL_IO_URING
+    if (ringReady) {
+        return "io_uring";
+    }
+#endif
+    return "pread";
+}
+
+void ChunkIO::load(std::vector<LoadRequest> &requests) {
+    LoadBatch batch = {&requests, {}};
+    std::future<void> done = batch.done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        loads.push_back(&batch);
+    }
+    wake.notify_one();
+    done.wait();
+}
+
+void ChunkIO::save(glm::ivec3 coords, const Block *blocks) {
+    std::vector<uint8_t> payload;
+    EncodeChunk(blocks, blockCount, payload);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint8_t> &slot = queued[{coords.x, coords.y, coords.z}];
+    if (!slot.empty()) {
+        coalescedSaves.fetch_add(1, std::memory_order_relaxed);
+        queuedBytes -= slot.size();
+        MemoryStats::remove(MEM_IO_QUEUE, slot.size());
+    }
+    queuedBytes += payload.size();
+    MemoryStats::add(MEM_IO_QUEUE, payload.size());
+    slot = std::move(payload);
+    if (queuedBytes >= MAX_QUEUED_BYTES) {
+        wake.notify_one();
+    }
+}
+
+void ChunkIO::flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t ticket = ++flushRequests;
+    wake.notify_one();
+    flushed.wait(lock, [&] { return flushesDone >= ticket; });
+}
+
+size_t ChunkIO::queueDepth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued.size() + loads.size();
+}
+
+void ChunkIO::run() {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastWrite = Clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        // reads first, somebody is waiting on them
+        if (!loads.empty()) {
+            LoadBatch *batch = loads.front();
+            loads.pop_front();
+            lock.unlock();
+            serve(*batch->requests);
+            batch->done.set_value();
+            lock.lock();
+            continue;
+        }
+
+        bool due = stopping || flushesDone < flushRequests ||
+                   queuedBytes >= MAX_QUEUED_BYTES ||
+                   Clock::now() - lastWrite >= flushInterval;
+        if (due && !queued.empty()) {
+            std::map<Key, std::vector<uint8_t>> chunks;
+            chunks.swap(queued);
+            queuedBytes = 0;
+            uint64_t requests = flushRequests;
+            lock.unlock();
+            // loads wait until this is done, so they never see a table
+            // entry without its payload
+            write(chunks);
+            lock.lock();
+            flushesDone = std::max(flushesDone, requests);
+            lastWrite = Clock::now();
+            flushed.notify_all();
+            continue;
+        }
+        if (due) {
+            lastWrite = Clock::now();
+        }
+        if (flushesDone < flushRequests) {
+            flushesDone = flushRequests;
+            flushed.notify_all();
+        }
+        if (stopping) {
+            break;
+        }
+        wake.wait_until(lock, lastWrite + flushInterval);
+    }
+}
+
+void ChunkIO::serve(std::vector<LoadRequest> &requests) {
+    std::vector<size_t> pending; // requests to read from disk
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < requests.size(); i++) {
+            LoadRequest &request = requests[i];
+            auto slot = queued.find({request.coords.x, request.coords.y, request.coords.z});
+            if (slot == queued.end()) {
+                pending.push_back(i);
+                continue;
+            }
+            request.found = DecodeChunk(slot->second.data(), slot->second.size(),
+                                        request.blocks, blockCount);
+        }
+    }
+
+    std::vector<Transfer> reads;
+    std::vector<size_t> readRequests;
+    size_t total = 0;
+    for (size_t i : pending) {
+        glm::ivec3 coords = requests[i].coords;
+        int index;
+        RegionFile *region = storage->region(coords.x, coords.y, coords.z, index);
+        RegionFile::Extent extent;
+        if (region == nullptr || !region->find(index, extent)) {
+            continue;
+        }
+        reads.push_back({region, index, extent, nullptr, false});
+        readRequests.push_back(i);
+        total += extent.size;
+    }
+    // one buffer for the whole batch
+    std::vector<uint8_t> buffer(total);
+    total = 0;
+    for (Transfer &read : reads) {
+        read.data = buffer.data() + total;
+        total += read.extent.size;
+    }
+    if (!transfer(reads, false)) {
+        strand(std::move(buffer)); // reads[].data stay valid
+    }
+
+    for (size_t r = 0; r < reads.size(); r++) {
+        LoadRequest &request = requests[readRequests[r]];
+        if (!reads[r].ok) {
+            continue;
+        }
+        request.found = DecodeChunk(reads[r].data, reads[r].extent.size, request.blocks,
+                                    blockCount);
+        if (!request.found) {
+            std::printf("corrupt chunk %d %d %d in %s, regenerating it\n",
+                        request.coords.x, request.coords.y, request.coords.z,
+                        storage->path().c_str());
+            continue;
+        }
+        chunksRead.fetch_add(1, std::memory_order_relaxed);
+        bytesRead.fetch_add(reads[r].extent.size, std::memory_order_relaxed);
+    }
+}
+
+void ChunkIO::write(std::map<Key, std::vector<uint8_t>> &chunks) {
+    // in key order, chunks of a region next to each other and new payloads
+    // appended in that order
+    std::vector<Transfer> writes;
+    writes.reserve(chunks.size());
+    for (auto &chunk : chunks) {
+        auto [x, y, z] = chunk.first;
+        int index;
+        RegionFile *region = storage->region(x, y, z, index);
+        MemoryStats::remove(MEM_IO_QUEUE, chunk.second.size());
+        if (region == nullptr) {
+            continue;
+        }
+        writes.push_back({region, index, region->allocate(index, chunk.second.size()),
+                          chunk.second.data(), false});
+    }
+    if (!transfer(writes, true)) {
+        for (auto &chunk : chunks) {
+            strand(std::move(chunk.second));
+        }
+    }
+
+    int failed = 0;
+    for (Transfer &write : writes) {
+        if (!write.ok || !write.region->commit(write.index, write.extent)) {
+            failed++;
+            continue;
+        }
+        chunksWritten.fetch_add(1, std::memory_order_relaxed);
+        bytesWritten.fetch_add(write.extent.size, std::memory_order_relaxed);
+    }
+    failed += (int)(chunks.size() - writes.size());
+    if (failed > 0) {
+        std::printf("couldn't save %d chunks to %s\n", failed, storage->path().c_str());
+    }
+    flushes.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ChunkIO::transfer(std::vector<Transfer> &transfers, bool write) {
+    bool stranded = false;
+#ifdef VOXEL_IO_URING
+    if (ringReady) {
+        // prepared: in the submission queue, submitted: taken by the kernel
+        // (in order), in flight until their completion comes
+        size_t prepared = 0, submitted = 0, completed = 0;
+        auto complete = [&](io_uring_cqe *cqe) {
+            Transfer *t = (Transfer *)io_uring_cqe_get_data(cqe);
+            t->ok = cqe->res == (int)t->extent.size;
+            t->inFlight = false;
+            io_uring_cqe_seen(&ring, cqe);
+            completed++;
+        };
+        int failure = 0;
+        while (completed < transfers.size()) {
+            while (prepared < transfers.size() && prepared - completed < URING_DEPTH) {
+                io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+                if (sqe == nullptr) {
+                    break;
+                }
+                Transfer &t = transfers[prepared++];
+                if (write) {
+                    io_uring_prep_write(sqe, t.region->descriptor(), t.data,
+                                        t.extent.size, t.extent.offset);
+                } else {
+                    io_uring_prep_read(sqe, t.region->descriptor(), t.data,
+                                       t.extent.size, t.extent.offset);
+                }
+                io_uring_sqe_set_data(sqe, &t);
+            }
+            int result = io_uring_submit(&ring);
+            bool retry = result == -EINTR || result == -EAGAIN || result == -EBUSY;
+            if (result < 0 && !retry) {
+                failure = result;
+                break;
+            }
+            for (int i = 0; i < result; i++) {
+                transfers[submitted++].inFlight = true;
+            }
+            if (submitted == completed) {
+                // nothing in flight that a completion could come from
+                if (result == -EINTR) {
+                    continue;
+                }
+                failure = result < 0 ? result : -EIO;
+                break;
+            }
+
+            io_uring_cqe *cqe;
+            result = io_uring_wait_cqe(&ring, &cqe);
+            if (result == -EINTR || result == -EAGAIN) {
+                continue;
+            }
+            if (result < 0) {
+                failure = result;
+                break;
+            }
+            complete(cqe);
+        }
+
+        if (failure != 0) {
+            // what's in flight still points at the buffers, so wait it out
+            // and stop using the ring, pread/pwrite below do the rest. If
+            // even waiting fails the caller has to keep the buffers
+            std::printf("io_uring failed (%d), using pread/pwrite\n", failure);
+            ringReady = false;
+            while (completed < submitted) {
+                io_uring_cqe *cqe;
+                int result = io_uring_wait_cqe(&ring, &cqe);
+                if (result == -EINTR || result == -EAGAIN) {
+                    continue;
+                }
+                if (result < 0) {
+                    break;
+                }
+                complete(cqe);
+            }
+            stranded = completed < submitted;
+        }
+        // short reads and writes (rare on regular files) go again below
+    }
+#endif
+    for (Transfer &t : transfers) {
+        // still in flight only when the ring broke, their buffer is the
+        // kernel's now
+        if (!t.ok && !t.inFlight) {
+            t.ok = write ? t.region->writeAt(t.data, t.extent.size, t.extent.offset)
+                         : t.region->readAt(t.data, t.extent.size, t.extent.offset);
+        }
+    }
+    return !stranded;
+}
+
+void ChunkIO::strand(std::vector<uint8_t> &&buffer) {
+    if (stranded == nullptr) {
+        stranded = new std::vector<std::vector<uint8_t>>();
+    }
+    stranded->push_back(std::move(buffer));
+}
+
+#endif // CHUNK_IO_H
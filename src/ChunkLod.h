@@ -0,0 +1,100 @@
+#ifndef CHUNKLOD_H
+#define CHUNKLOD_H
+
+#include "Block.h"
+
+/*
+    Level of detail for far chunks.
+    Level l meshes the chunk as cells of 2^l blocks per side (2x, 4x, 8x),
+    built from the full resolution blocks by DownsampleBlocks.
+    Every chunk still adds the faces on its border, those act as skirts that
+    close the seams between neighbours meshed at different levels.
+*/
+
+static constexpr int MAX_LOD_LEVEL = 3;
+
+// distance in chunks beyond which level l + 1 is used
+static constexpr float LOD_DISTANCES[MAX_LOD_LEVEL] = {4.0f, 8.0f, 16.0f};
+
+// how far (in chunks) past a threshold the camera has to move before the
+// level changes, so chunks on a boundary don't keep switching
+static constexpr float LOD_HYSTERESIS = 0.5f;
+
+inline int LodLevelForDistance(float distance) {
+    int level = 0;
+    while (level < MAX_LOD_LEVEL && distance > LOD_DISTANCES[level]) {
+        level++;
+    }
+    return level;
+}
+
+// keeps the current level while the distance is within the hysteresis band
+// of its thresholds
+inline int SelectLodLevel(int currentLevel, float distance) {
+    int nearLevel = LodLevelForDistance(distance - LOD_HYSTERESIS);
+    int farLevel = LodLevelForDistance(distance + LOD_HYSTERESIS);
+    if (currentLevel >= nearLevel && currentLevel <= farLevel) {
+        return currentLevel;
+    }
+    return LodLevelForDistance(distance);
+}
+
+/*
+    Reduce a chunkSize^3 block array to cells of 2^level blocks.
+    A cell is solid when it holds at least one layer's worth of blocks
+    (cellSize^2). For 2x that is half the cell (a tie counts as solid), for
+    4x and 8x it keeps thin floors and surfaces from disappearing.
+    The cell takes the most common type among the blocks that are on top
+    of their column inside the cell, so grass stays grass from afar.
+*/
+inline void DownsampleBlocks(const Block *blocks, int chunkSize, int level,
+                             Block *out) {
+    int cellSize = 1 << level;
+    int gridSize = chunkSize / cellSize;
+
+    for (int cz = 0; cz < gridSize; cz++) {
+        for (int cy = 0; cy < gridSize; cy++) {
+            for (int cx = 0; cx < gridSize; cx++) {
+                int active = 0;
+                int surfaceCount[BlockType::NumTypes] = {0};
+
+                for (int z = cz * cellSize; z < (cz + 1) * cellSize; z++) {
+                    for (int x = cx * cellSize; x < (cx + 1) * cellSize; x++) {
+                        bool covered = false; // active block above in cell
+                        for (int y = (cy + 1) * cellSize - 1;
+                             y >= cy * cellSize; y--) {
+                            const Block &block =
+                                blocks[x + y * chunkSize +
+                                       z * chunkSize * chunkSize];
+                            if (!block.isActive) {
+                                covered = false;
+                                continue;
+                            }
+                            active++;
+                            if (!covered) {
+                                surfaceCount[block.blockType]++;
+                            }
+                            covered = true;
+                        }
+                    }
+                }
+
+                Block &cell = out[cx + cy * gridSize + cz * gridSize * gridSize];
+                cell.isActive = active >= cellSize * cellSize;
+                cell.blockType = BlockType::Default;
+                if (!cell.isActive) {
+                    continue;
+                }
+                int best = 0;
+                for (int type = 0; type < BlockType::NumTypes; type++) {
+                    if (surfaceCount[type] > best) {
+                        best = surfaceCount[type];
+                        cell.blockType = (BlockType)type;
+                    }
+                }
+            }
+        }
+    }
+}
+
+#endif // CHUNKLOD_H
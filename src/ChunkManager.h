@@ -2,18 +2,25 @@
 #define CHUNKMANAGER_H
 
 #include "Chunk.h"
+#include "Decorations.h"
+#include "RenderQueue.h"
 
 #include <learnopengl/shader_m.h>
+#include <chrono>
+#include <condition_variable>
+#include <limits>
 #include <unordered_map>
 #include <vector>
 #include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
 
 /*
     TODO LIST:
     - feat: async chunk loading?
     - feat: chunk unloading?
-    - fix: some chunks (def. first one) has weird alpha rendering bug - need to
-   investigate the cause of this later.
 */
 
 class TPoint3D {
@@ -69,6 +76,24 @@ struct ChunkManager {
         return result;
     }
 
+    // grid coordinates of a chunk, 0 to WORLD_SIZE - 1 on each axis
+    inline glm::ivec3 getChunkCoords(const Chunk *chunk) const {
+        int halfWorldSize =
+            (WORLD_SIZE * (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE)) / 2;
+        glm::vec3 coords = (chunk->chunkPosition + glm::vec3(halfWorldSize)) /
+                           (float)(Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE);
+        return glm::ivec3(coords);
+    }
+
+    // chunk at grid coordinates, nullptr if outside the world or not created
+    inline Chunk *getChunk(int x, int y, int z) const {
+        if (x < 0 || x >= WORLD_SIZE || y < 0 || y >= WORLD_SIZE || z < 0 ||
+            z >= WORLD_SIZE) {
+            return nullptr;
+        }
+        return chunks[getChunkIndex(x, y, z)];
+    }
+
     std::shared_ptr<std::mutex> chunkMutex;
     std::shared_ptr<std::mutex> visibilityMutex;
     ChunkManager();
@@ -85,10 +110,29 @@ struct ChunkManager {
     void updateUnloadList(glm::vec3 newCameraPosition);
     void updateVisibilityList(glm::vec3 newCameraPosition);
     void updateRenderList(glm::vec3 newCameraPosition, Frustum frustum);
+    void updateOcclusionCulling(Camera newCamera);
+    void updateLodList(glm::vec3 newCameraPosition);
+    void generateChunks(const std::vector<Chunk *> &ungenerated);
+    // queues every generated chunk that isn't saved yet on io and waits
+    // until they're written
+    void saveChunks();
 
-    void pregenerateChunks();
+    // creates every chunk of the world and starts streaming them in from
+    // cameraPosition outwards, see streamWorker
+    void pregenerateChunks(glm::vec3 cameraPosition);
+    // render thread: block (uploading meshes as they come) until the
+    // chunks around position are set up, or all of them are
+    void waitForChunksAround(glm::vec3 position);
+    void finishStreaming();
+    // what's meshed is uploaded, what isn't is left to updateSetupList
+    void stopStreaming();
+    bool isStreaming() const { return streaming; }
+    void streamWorker();
+    void uploadStreamedChunks(double budgetMs);
 
     void QueueChunkToRebuild(Chunk *chunk);
+    void QueueNeighboursToRebuild(Chunk *chunk);
+    ChunkNeighbourhood GetNeighbourhood(Chunk *chunk);
     std::pair<glm::vec3, glm::vec3>
     GetChunkGenRange(glm::vec3 newCameraPosition);
     std::pair<glm::vec3, glm::vec3>
@@ -103,6 +147,38 @@ struct ChunkManager {
     ChunkList chunkRenderList;
     ChunkList chunkUnloadList;
     ChunkList chunkVisibilityList;
+    RenderQueue renderQueue;
+
+    // only draw chunks the camera can see into through open chunk faces
+    bool caveCulling = true;
+    int caveCulledCount = 0; // chunks in the frustum skipped last frame
+    std::vector<bool> chunkReachable;
+
+    // hide chunks behind the solid bottoms of the nearest chunks, see
+    // OcclusionCulling.h
+    static constexpr int MAX_OCCLUDERS = 32;
+    bool occlusionCulling = true;
+    int occlusionTestedCount = 0;
+    int occlusionCulledCount = 0;
+    OcclusionBuffer occlusionBuffer;
+
+    // how long each step of the last update() took, in ms
+    enum UpdateStage {
+        STAGE_LOAD = 0,
+        STAGE_LOD,
+        STAGE_SETUP,
+        STAGE_REBUILD,
+        STAGE_VISIBILITY,
+        STAGE_RENDER_LIST,
+        STAGE_OCCLUSION,
+        STAGE_RENDER_QUEUE,
+        NUM_UPDATE_STAGES,
+    };
+    static constexpr const char *UPDATE_STAGE_NAMES[NUM_UPDATE_STAGES] = {
+        "load",       "lod",         "setup",     "rebuild",
+        "visibility", "render_list", "occlusion", "render_queue",
+    };
+    double stageMs[NUM_UPDATE_STAGES] = {0};
 
     bool genChunk;
     bool forceVisibilityupdate;
@@ -111,11 +187,73 @@ struct ChunkManager {
     unsigned int chunkGenDistance;
     unsigned int chunkRenderDistance;
     TerrainGenerator *terrainGenerator = nullptr;
+
+    // trees and boulders across chunk borders, see Decorations.h
+    bool decorate = true;
+    std::unique_ptr<DecorationPass> decorations;
+
+    // saved chunks are loaded through here instead of generated, and
+    // unloaded ones saved, nullptr for none (no --world)
+    ChunkIO *io = nullptr;
+
+    // finished meshes from earlier sessions, nullptr for none
+    // (no --mesh-cache)
+    MeshCache *meshCache = nullptr;
+
+    // startup streaming: worker threads generate and mesh the chunks from
+    // pregenerateChunks nearest first, the render thread only uploads them,
+    // at most STREAM_UPLOAD_BUDGET_MS of it a frame
+    static constexpr double STREAM_UPLOAD_BUDGET_MS = 4.0;
+    // a chunk is meshed once every chunk this close is decorated, see
+    // streamWorker
+    static constexpr int STREAM_READY_RADIUS = 2;
+    bool uploadMeshes = true; // false without a GL context (voxel-bench)
+    unsigned int streamThreads = 0; // 0 for one per core
+    size_t streamedChunks = 0; // set up so far
+    size_t streamTotal = 0;
+    bool streaming = false;
+    bool streamStop = false;
+    std::vector<std::thread> streamWorkers;
+    std::vector<int> streamOrder;   // chunk indices, nearest first
+    std::vector<int> streamRank;    // chunk index -> place in streamOrder, -1 if not streamed
+    std::vector<int> streamPending; // chunk index -> undecorated chunks around it
+    size_t streamNextGenerate = 0;  // in streamOrder
+    size_t streamMeshed = 0;
+    // (rank, chunk index) of chunks ready to mesh, nearest on top
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>,
+                        std::greater<std::pair<int, int>>>
+        streamMeshQueue;
+    std::vector<Chunk *> streamBuilt;   // meshed, for the render thread
+    std::vector<Chunk *> streamUploads; // render thread only
+    std::mutex streamMutex;
+    std::condition_variable streamWork;  // workers wait for this
+    std::condition_variable streamReady; // the render thread waits for this
+
+    // streamed chunks within radius of the chunk at index (itself too)
+    template <typename F> void forEachStreamedAround(int index, int radius, F &&f) {
+        int x = index % WORLD_SIZE;
+        int y = index / WORLD_SIZE % WORLD_SIZE;
+        int z = index / (WORLD_SIZE * WORLD_SIZE);
+        for (int dz = -radius; dz <= radius; dz++) {
+            for (int dy = -radius; dy <= radius; dy++) {
+                for (int dx = -radius; dx <= radius; dx++) {
+                    if (getChunk(x + dx, y + dy, z + dz) == nullptr) {
+                        continue;
+                    }
+                    int around = getChunkIndex(x + dx, y + dy, z + dz);
+                    if (streamRank[around] >= 0) {
+                        f(around);
+                    }
+                }
+            }
+        }
+    }
 };
 ChunkManager::ChunkManager() {
     chunkMutex = std::make_shared<std::mutex>();
     visibilityMutex = std::make_shared<std::mutex>();
     terrainGenerator = new TerrainGenerator(Chunk::CHUNK_SIZE, 0);
+    decorations = std::make_unique<DecorationPass>(0, -1);
 }
 
 ChunkManager::ChunkManager(unsigned int _chunkGenDistance,
@@ -128,12 +266,14 @@ ChunkManager::ChunkManager(unsigned int _chunkGenDistance,
     genChunk = true;
     bool forceVisibilityupdate = true;
     this->terrainGenerator = terrainGenerator;
+    // the top chunk layer ends at world y 0
+    decorations = std::make_unique<DecorationPass>(terrainGenerator->getSeed(), -1);
 
     chunkMutex = std::make_shared<std::mutex>();
     visibilityMutex = std::make_shared<std::mutex>();
 }
 
-ChunkManager::~ChunkManager() {}
+ChunkManager::~ChunkManager() { stopStreaming(); }
 
 // TODO: surely we can just pass the camera right?
 void ChunkManager::update(float dt, Camera newCamera) {
@@ -143,15 +283,33 @@ void ChunkManager::update(float dt, Camera newCamera) {
     //     // this,
     //     //    newCameraPosition);
     // }
-    updateLoadList();
+    PROFILE_SCOPE("update");
+    auto timed = [&](UpdateStage stage, auto &&step) {
+        PROFILE_SCOPE(UPDATE_STAGE_NAMES[stage]);
+        auto start = std::chrono::steady_clock::now();
+        step();
+        stageMs[stage] = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    };
+
+    timed(STAGE_LOAD, [&] { updateLoadList(); });
     // std::async(std::launch::async, &ChunkManager::updateLoadList, this);
-    updateSetupList();
+    timed(STAGE_LOD, [&] { updateLodList(newCamera.cameraPos); });
+    timed(STAGE_SETUP, [&] { updateSetupList(); });
     // std::async(std::launch::async, &ChunkManager::updateSetupList, this);
-    updateRebuildList();
+    timed(STAGE_REBUILD, [&] { updateRebuildList(); });
     // updateFlagsList();
     // updateUnloadList(newCameraPosition);
-    updateVisibilityList(newCamera.cameraPos);
-    updateRenderList(newCamera.cameraPos, newCamera.frustum);
+    timed(STAGE_VISIBILITY,
+          [&] { updateVisibilityList(newCamera.cameraPos); });
+    timed(STAGE_RENDER_LIST, [&] {
+        updateRenderList(newCamera.cameraPos, newCamera.frustum);
+    });
+    timed(STAGE_OCCLUSION, [&] { updateOcclusionCulling(newCamera); });
+    timed(STAGE_RENDER_QUEUE, [&] {
+        renderQueue.build(chunkRenderList, newCamera.cameraPos);
+    });
     camera = newCamera;
     // cameraPosition = camera.cameraPos;
     // cameraLookAt = newCameraLookAt;
@@ -226,53 +384,254 @@ ChunkManager::GetChunkRenderRange(glm::vec3 newCameraPosition) {
                                            {endX, endY, endZ});
 }
 
-void ChunkManager::pregenerateChunks() {
-    int halfWorldSize =
-        (WORLD_SIZE * (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE)) / 2;
-
-    std::vector<std::future<void>> futures; // Store futures to manage threads
-
-    for (float i = -halfWorldSize; i < halfWorldSize;
-         i += Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) {
-        for (float j = -halfWorldSize; j < halfWorldSize;
-             j += Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) {
-            for (float k = -halfWorldSize; k < halfWorldSize;
-                 k += Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) {
+void ChunkManager::pregenerateChunks(glm::vec3 cameraPosition) {
+    PROFILE_SCOPE("pregenerate");
+    constexpr float chunkWorldSize = Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+    int halfWorldSize = (WORLD_SIZE * chunkWorldSize) / 2;
 
+    // chunk objects only, the blocks and meshes are the stream's
+    for (float i = -halfWorldSize; i < halfWorldSize; i += chunkWorldSize) {
+        for (float j = -halfWorldSize; j < halfWorldSize; j += chunkWorldSize) {
+            for (float k = -halfWorldSize; k < halfWorldSize; k += chunkWorldSize) {
                 if (j > -Block::BLOCK_RENDER_SIZE) {
                     continue;
                 }
+                size_t idx = chunkIndexFromChunkPos((int)i, (int)j, (int)k);
+                if (chunks[idx] != nullptr) {
+                    continue;
+                }
+                Chunk *newChunk = new Chunk({i, j, k}, terrainShader);
+                chunks[idx] = newChunk;
+                chunkVisibilityList.push_back(newChunk);
+            }
+        }
+    }
 
-                // Launch a new thread for each chunk generation
-                futures.emplace_back(std::async(std::launch::async, [this, i, j,
-                                                                     k]() {
-                    std::lock_guard<std::mutex> lock(
-                        *chunkMutex); // Ensure thread safety
+    // nearest first, ties in index order. Levels of detail are picked here
+    // once, updateLodList leaves chunks alone until they're set up
+    std::vector<std::pair<float, int>> byDistance;
+    for (Chunk *chunk : chunkVisibilityList) {
+        if (chunk->isGenerated()) {
+            continue;
+        }
+        glm::ivec3 coords = getChunkCoords(chunk);
+        glm::vec3 chunkCenter = chunk->chunkPosition + glm::vec3(chunkWorldSize / 2);
+        float distance = glm::length(chunkCenter - cameraPosition) / chunkWorldSize;
+        chunk->targetLodLevel = SelectLodLevel(chunk->targetLodLevel, distance);
+        chunk->load();
+        byDistance.push_back({distance, getChunkIndex(coords.x, coords.y, coords.z)});
+    }
+    std::sort(byDistance.begin(), byDistance.end());
+    streamOrder.clear();
+    streamRank.assign(WORLD_SIZE_CUBED, -1);
+    for (auto &entry : byDistance) {
+        streamRank[entry.second] = (int)streamOrder.size();
+        streamOrder.push_back(entry.second);
+    }
+    streamPending.assign(WORLD_SIZE_CUBED, 0);
+    for (int index : streamOrder) {
+        forEachStreamedAround(index, STREAM_READY_RADIUS,
+                              [&](int) { streamPending[index]++; });
+    }
 
-                    size_t idx = chunkIndexFromChunkPos((int)i, (int)j, (int)k);
-                    Chunk *currChunk = chunks[idx];
-                    if (currChunk != nullptr) {
-                        return;
-                    }
+    streamTotal = streamOrder.size();
+    streamedChunks = 0;
+    streamMeshed = 0;
+    streamNextGenerate = 0;
+    streamStop = false;
+    streaming = streamTotal > 0;
+    if (!streaming) {
+        return;
+    }
+    unsigned int threadCount = streamThreads > 0
+                                   ? streamThreads
+                                   : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threadCount; i++) {
+        streamWorkers.emplace_back(&ChunkManager::streamWorker, this);
+    }
+}
 
-                    // Create new chunk
-                    Chunk *newChunk = new Chunk({i, j, k}, terrainShader);
-                    chunks[idx] = newChunk;
+/*
+    One stream worker. Takes the nearest chunk that's ready to mesh, or else
+    the nearest chunk not generated yet:
 
-                    std::lock_guard<std::mutex> visibilityLock(
-                        *visibilityMutex);
-                    chunkVisibilityList.push_back(newChunk);
-                }));
+        generate: terrain (or load it from io), then decorate
+        mesh:     buildMesh, handed to the render thread for the upload
+
+    Decorations reach one chunk across, so a chunk's blocks are final once
+    everything within 1 chunk is decorated, and its mesh also reads the
+    blocks of the chunks around it. So a chunk is meshed once every chunk
+    within STREAM_READY_RADIUS (2) is decorated: nothing writes to the
+    blocks it reads any more, and the mesh never has to be rebuilt because
+    of the stream's order.
+*/
+void ChunkManager::streamWorker() {
+    Profiler::get().setThreadName("stream");
+    while (true) {
+        int index;
+        bool mesh;
+        {
+            std::unique_lock<std::mutex> lock(streamMutex);
+            streamWork.wait(lock, [&] {
+                return streamStop || !streamMeshQueue.empty() ||
+                       streamNextGenerate < streamOrder.size() ||
+                       streamMeshed == streamTotal;
+            });
+            // not done until the last mesh is built: chunks other workers
+            // are still generating can make more meshes ready
+            if (streamStop || streamMeshed == streamTotal) {
+                return;
             }
+            mesh = !streamMeshQueue.empty();
+            if (mesh) {
+                index = streamMeshQueue.top().second;
+                streamMeshQueue.pop();
+            } else {
+                index = streamOrder[streamNextGenerate++];
+            }
+        }
+
+        Chunk *chunk = chunks[index];
+        if (mesh) {
+            chunk->buildMesh(GetNeighbourhood(chunk), meshCache);
+            bool done;
+            {
+                std::lock_guard<std::mutex> lock(streamMutex);
+                streamBuilt.push_back(chunk);
+                done = ++streamMeshed == streamTotal;
+            }
+            streamReady.notify_one();
+            if (done) {
+                streamWork.notify_all();
+            }
+            continue;
+        }
+
+        Chunk::generateBatch({chunk}, terrainGenerator, io);
+        if (decorate) {
+            PROFILE_SCOPE("decorate");
+            // loaded chunks were saved with their features
+            if (chunk->unsaved) {
+                decorations->decorate(chunk);
+            } else {
+                decorations->skip(chunk);
+            }
+        }
+        bool ready = false;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            forEachStreamedAround(index, STREAM_READY_RADIUS, [&](int around) {
+                if (--streamPending[around] == 0) {
+                    streamMeshQueue.push({streamRank[around], around});
+                    ready = true;
+                }
+            });
+        }
+        if (ready) {
+            streamWork.notify_all();
         }
     }
+}
 
-    // Wait for all threads to finish
-    for (auto &fut : futures) {
-        fut.get();
+// render thread: finish setting up meshed chunks, nearest first, until
+// budgetMs is used up (at least one)
+void ChunkManager::uploadStreamedChunks(double budgetMs) {
+    PROFILE_SCOPE("stream upload");
+    {
+        std::lock_guard<std::mutex> lock(streamMutex);
+        streamUploads.insert(streamUploads.end(), streamBuilt.begin(),
+                             streamBuilt.end());
+        streamBuilt.clear();
+    }
+    auto start = std::chrono::steady_clock::now();
+    size_t uploaded = 0;
+    while (uploaded < streamUploads.size()) {
+        streamUploads[uploaded++]->finishSetup(uploadMeshes);
+        streamedChunks++;
+        forceVisibilityupdate = true;
+        if (std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count() >= budgetMs) {
+            break;
+        }
+    }
+    streamUploads.erase(streamUploads.begin(), streamUploads.begin() + uploaded);
+
+    if (streaming && streamedChunks == streamTotal) {
+        for (std::thread &worker : streamWorkers) {
+            worker.join();
+        }
+        streamWorkers.clear();
+        // every mesh was built after the last write into the blocks it
+        // read, nothing the decorations touched needs a rebuild
+        decorations->takeTouched();
+        streaming = false;
+    }
+}
+
+void ChunkManager::waitForChunksAround(glm::vec3 position) {
+    constexpr float chunkWorldSize = Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+    constexpr float halfWorldSize = (WORLD_SIZE * chunkWorldSize) / 2;
+    glm::ivec3 coords =
+        glm::ivec3(glm::floor((position + glm::vec3(halfWorldSize)) / chunkWorldSize));
+    std::vector<Chunk *> around;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (Chunk *chunk = getChunk(coords.x + dx, coords.y + dy, coords.z + dz)) {
+                    around.push_back(chunk);
+                }
+            }
+        }
+    }
+    // nothing around the camera, the nearest chunk then
+    if (around.empty() && !streamOrder.empty()) {
+        around.push_back(chunks[streamOrder[0]]);
+    }
+    auto ready = [&] {
+        return std::all_of(around.begin(), around.end(),
+                           [](Chunk *chunk) { return chunk->isSetup(); });
+    };
+    while (streaming && !ready()) {
+        {
+            std::unique_lock<std::mutex> lock(streamMutex);
+            streamReady.wait(lock, [&] {
+                return !streamBuilt.empty() || !streamUploads.empty();
+            });
+        }
+        uploadStreamedChunks(std::numeric_limits<double>::infinity());
     }
 }
 
+void ChunkManager::finishStreaming() {
+    while (streaming) {
+        {
+            std::unique_lock<std::mutex> lock(streamMutex);
+            streamReady.wait(lock, [&] {
+                return !streamBuilt.empty() || !streamUploads.empty();
+            });
+        }
+        uploadStreamedChunks(std::numeric_limits<double>::infinity());
+    }
+}
+
+void ChunkManager::stopStreaming() {
+    if (!streaming) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(streamMutex);
+        streamStop = true;
+    }
+    streamWork.notify_all();
+    for (std::thread &worker : streamWorkers) {
+        worker.join();
+    }
+    streamWorkers.clear();
+    uploadStreamedChunks(std::numeric_limits<double>::infinity());
+    streaming = false;
+}
+
 void ChunkManager::updateAsyncChunker(Camera newCamera) {
     if (newCamera.cameraPos == camera.cameraPos) {
         return;
@@ -283,7 +642,8 @@ void ChunkManager::updateAsyncChunker(Camera newCamera) {
     glm::vec3 start = chunkRange.first;
     glm::vec3 end = chunkRange.second;
 
-    std::vector<std::future<void>> futures; // Store futures to manage threads
+    // chunks go into the visibility list in loop order, see pregenerateChunks
+    std::vector<std::future<Chunk *>> futures;
 
     for (float i = start.x; i < end.x;
          i += Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) {
@@ -298,28 +658,20 @@ void ChunkManager::updateAsyncChunker(Camera newCamera) {
 
                 // Launch a new thread for each chunk generation
                 futures.emplace_back(std::async(std::launch::async, [this, i, j,
-                                                                     k]() {
+                                                                     k]() -> Chunk * {
                     std::lock_guard<std::mutex> lock(
                         *chunkMutex); // Ensure thread safety
 
                     size_t idx = chunkIndexFromChunkPos((int)i, (int)j, (int)k);
                     Chunk *currChunk = chunks[idx];
                     if (currChunk != nullptr) {
-                        if (!currChunk->isLoaded()) {
-                            std::lock_guard<std::mutex> visibilityLock(
-                                *visibilityMutex);
-                            chunkVisibilityList.push_back(currChunk);
-                        }
-                        return;
+                        return currChunk->isLoaded() ? nullptr : currChunk;
                     }
 
                     // Create new chunk
                     Chunk *newChunk = new Chunk({i, j, k}, terrainShader);
                     chunks[idx] = newChunk;
-
-                    std::lock_guard<std::mutex> visibilityLock(
-                        *visibilityMutex);
-                    chunkVisibilityList.push_back(newChunk);
+                    return newChunk;
                 }));
             }
         }
@@ -327,7 +679,9 @@ void ChunkManager::updateAsyncChunker(Camera newCamera) {
 
     // Wait for all threads to finish
     for (auto &fut : futures) {
-        fut.get();
+        if (Chunk *chunk = fut.get()) {
+            chunkVisibilityList.push_back(chunk);
+        }
     }
 }
 
@@ -350,14 +704,97 @@ void ChunkManager::updateLoadList() {
     chunkLoadList.clear();
 }
 
+// terrain, then features, of the chunks split over worker threads. Each
+// thread gets a run of chunks in list order (whole columns stay together
+// for the generator's batch), DecorationPass takes care of the borders
+void ChunkManager::generateChunks(const std::vector<Chunk *> &ungenerated) {
+    size_t threadCount = std::min<size_t>(
+        std::max(1u, std::thread::hardware_concurrency()), ungenerated.size());
+    size_t perThread = (ungenerated.size() + threadCount - 1) / threadCount;
+    std::vector<std::future<void>> futures;
+    for (size_t start = 0; start < ungenerated.size(); start += perThread) {
+        futures.push_back(std::async(std::launch::async, [this, &ungenerated,
+                                                          start, perThread] {
+            std::vector<Chunk *> slice(
+                ungenerated.begin() + start,
+                ungenerated.begin() +
+                    std::min(start + perThread, ungenerated.size()));
+            Chunk::generateBatch(slice, terrainGenerator, io);
+            if (decorate) {
+                PROFILE_SCOPE("decorate");
+                for (Chunk *chunk : slice) {
+                    // loaded chunks were saved with their features
+                    if (chunk->unsaved) {
+                        decorations->decorate(chunk);
+                    } else {
+                        decorations->skip(chunk);
+                    }
+                }
+            }
+        }));
+    }
+    for (auto &future : futures) {
+        future.get();
+    }
+}
+
+void ChunkManager::saveChunks() {
+    // the workers write blocks and unsaved
+    stopStreaming();
+    if (io == nullptr) {
+        return;
+    }
+    PROFILE_SCOPE("save");
+    for (Chunk *chunk : chunks) {
+        if (chunk != nullptr && chunk->isGenerated() && chunk->unsaved) {
+            io->save(chunk->storageCoords(), chunk->blocks);
+            chunk->unsaved = false;
+        }
+    }
+    io->flush();
+}
+
 void ChunkManager::updateSetupList() { // Setup any chunks that have not
                                        // already been setup
+    // the stream generates and meshes its chunks, only the uploads are left
+    // for here. Touched chunks wait too, the stream doesn't need them
+    if (streaming) {
+        uploadStreamedChunks(STREAM_UPLOAD_BUDGET_MS);
+        chunkSetupList.clear();
+        return;
+    }
+
+    // generate every chunk first, so chunks meshed this frame can already
+    // see the blocks of neighbours set up in the same frame. One batch for
+    // all of them, generators share work between neighbours
+    std::vector<Chunk *> ungenerated;
     ChunkList::iterator iterator;
     for (iterator = chunkSetupList.begin(); iterator != chunkSetupList.end();
          ++iterator) {
         Chunk *pChunk = (*iterator);
-        if (pChunk->isLoaded() && pChunk->isSetup() == false) {
-            pChunk->setup(terrainGenerator);
+        if (pChunk->isLoaded() && !pChunk->isGenerated()) {
+            ungenerated.push_back(pChunk);
+        }
+    }
+    if (!ungenerated.empty()) {
+        generateChunks(ungenerated);
+    }
+    for (Chunk *pChunk : ungenerated) {
+        // neighbours meshed in an earlier frame treated this chunk as air
+        QueueNeighboursToRebuild(pChunk);
+    }
+    // trees of the new chunks reaching into chunks that are already meshed
+    for (Chunk *pChunk : decorations->takeTouched()) {
+        if (pChunk->isSetup()) {
+            QueueChunkToRebuild(pChunk);
+        }
+    }
+
+    for (iterator = chunkSetupList.begin(); iterator != chunkSetupList.end();
+         ++iterator) {
+        Chunk *pChunk = (*iterator);
+        if (pChunk->isGenerated() && pChunk->isSetup() == false) {
+            pChunk->setup(GetNeighbourhood(pChunk), meshCache);
             if (pChunk->isSetup()) { // Only force the visibility update if we
                                      // actually setup the chunk, some chunks
                                      // wait in the pre-setup stage...
@@ -368,10 +805,49 @@ void ChunkManager::updateSetupList() { // Setup any chunks that have not
     chunkSetupList.clear();
 }
 
+ChunkNeighbourhood ChunkManager::GetNeighbourhood(Chunk *chunk) {
+    ChunkNeighbourhood neighbourhood;
+    glm::ivec3 coords = getChunkCoords(chunk);
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                Chunk *neighbour =
+                    getChunk(coords.x + dx, coords.y + dy, coords.z + dz);
+                if (neighbour != nullptr && neighbour->isGenerated()) {
+                    neighbourhood.blocks[(dx + 1) + (dy + 1) * 3 +
+                                         (dz + 1) * 9] = neighbour->blocks;
+                }
+            }
+        }
+    }
+    return neighbourhood;
+}
+
 void ChunkManager::QueueChunkToRebuild(Chunk *chunk) {
+    if (chunk->queuedForRebuild) {
+        return;
+    }
+    chunk->queuedForRebuild = true;
     chunkRebuildList.push_back(chunk);
 }
 
+// queue the already meshed chunks around a chunk whose blocks changed
+void ChunkManager::QueueNeighboursToRebuild(Chunk *chunk) {
+    glm::ivec3 coords = getChunkCoords(chunk);
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                Chunk *neighbour =
+                    getChunk(coords.x + dx, coords.y + dy, coords.z + dz);
+                if (neighbour != nullptr && neighbour != chunk &&
+                    neighbour->isSetup()) {
+                    QueueChunkToRebuild(neighbour);
+                }
+            }
+        }
+    }
+}
+
 void ChunkManager::updateRebuildList() {
     // Rebuild any chunks that are in the rebuild chunk list
     ChunkList::iterator iterator;
@@ -381,43 +857,16 @@ void ChunkManager::updateRebuildList() {
          (lNumRebuiltChunkThisFrame != ASYNC_NUM_CHUNKS_PER_FRAME);
          ++iterator) {
         Chunk *pChunk = (*iterator);
+        pChunk->queuedForRebuild = false;
         if (pChunk->isLoaded() && pChunk->isSetup()) {
-            if (lNumRebuiltChunkThisFrame != ASYNC_NUM_CHUNKS_PER_FRAME) {
-                pChunk->rebuildMesh(); // If we rebuild a chunk, add it to the
-                                       // list of chunks that need their render
-                                       // flags updated
-                // since we might now be empty or surrounded
-                // m_vpChunkupdateFlagsList.push_back(pChunk); // Also add our
-                // neighbours since they might now be surrounded too (If we have
-                // neighbours) Chunk * pChunkXMinus = GetChunk(pChunk -> GetX()
-                // - 1, pChunk -> GetY(), pChunk -> GetZ()); Chunk * pChunkXPlus
-                // = GetChunk(pChunk -> GetX() + 1, pChunk -> GetY(), pChunk ->
-                // GetZ()); Chunk * pChunkYMinus = GetChunk(pChunk -> GetX(),
-                // pChunk -> GetY() - 1, pChunk -> GetZ()); Chunk * pChunkYPlus
-                // = GetChunk(pChunk -> GetX(), pChunk -> GetY() + 1, pChunk ->
-                // GetZ()); Chunk * pChunkZMinus = GetChunk(pChunk -> GetX(),
-                // pChunk -> GetY(), pChunk -> GetZ() - 1); Chunk * pChunkZPlus
-                // = GetChunk(pChunk -> GetX(), pChunk -> GetY(), pChunk ->
-                // GetZ() + 1); if (pChunkXMinus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkXMinus); if
-                // (pChunkXPlus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkXPlus); if
-                // (pChunkYMinus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkYMinus); if
-                // (pChunkYPlus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkYPlus); if
-                // (pChunkZMinus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkZMinus); if
-                // (pChunkZPlus != NULL)
-                // m_vpChunkupdateFlagsList.push_back(pChunkZPlus); // Only
-                // rebuild a certain number of chunks per frame
-                lNumRebuiltChunkThisFrame++;
-                forceVisibilityupdate = true;
-            }
+            pChunk->rebuildMesh(GetNeighbourhood(pChunk), meshCache);
+            // Only rebuild a certain number of chunks per frame
+            lNumRebuiltChunkThisFrame++;
+            forceVisibilityupdate = true;
         }
     }
-    // Clear the rebuild list
-    chunkRebuildList.clear();
+    // Remove the rebuilt chunks, the rest wait for the next frame
+    chunkRebuildList.erase(chunkRebuildList.begin(), iterator);
 }
 
 // unload chunks
@@ -439,7 +888,7 @@ void ChunkManager::updateRebuildList() {
 //                    pChunk->chunkPosition.y <= end.y) &&
 //                   (start.z <= pChunk->chunkPosition.z &&
 //                    pChunk->chunkPosition.z <= end.z))) {
-//                 pChunk->unload();
+//                 pChunk->unload(io);
 //                 chunks.erase(TPoint3D(pChunk->chunkPosition.x,
 //                                       pChunk->chunkPosition.y,
 //                                       pChunk->chunkPosition.z));
@@ -452,50 +901,196 @@ void ChunkManager::updateRebuildList() {
 
 void ChunkManager::updateRenderList(glm::vec3 newCameraPosition,
                                     Frustum frustum) {
+    constexpr float chunkWorldSize =
+        Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+    constexpr float halfWorldSize = (WORLD_SIZE * chunkWorldSize) / 2;
+
+    std::pair<glm::vec3, glm::vec3> chunkRange =
+        GetChunkRenderRange(newCameraPosition);
+    glm::vec3 start = chunkRange.first;
+    glm::vec3 end = chunkRange.second;
+
+    // render distance and frustum test for the chunk at chunkPosition
+    auto inView = [&](glm::vec3 chunkPosition) -> bool {
+        if (!((start.x <= chunkPosition.x && chunkPosition.x <= end.x) &&
+              (start.y <= chunkPosition.y && chunkPosition.y <= end.y) &&
+              (start.z <= chunkPosition.z && chunkPosition.z <= end.z))) {
+            return false;
+        }
+        glm::vec3 chunkCenter = chunkPosition + glm::vec3(chunkWorldSize / 2);
+        return frustum.CubeInFrustum(chunkCenter, chunkWorldSize / 2,
+                                     chunkWorldSize / 2, chunkWorldSize / 2);
+    };
+
+    // walk the chunk grid from the camera's chunk through connected faces,
+    // chunks that aren't reached are hidden behind solid ground.
+    // outside the world there's nothing to start from so everything in the
+    // frustum is drawn
+    glm::ivec3 cameraCoords = glm::ivec3(
+        glm::floor((newCameraPosition + glm::vec3(halfWorldSize)) /
+                   chunkWorldSize));
+    bool cull = caveCulling && cameraCoords.x >= 0 &&
+                cameraCoords.x < WORLD_SIZE && cameraCoords.y >= 0 &&
+                cameraCoords.y < WORLD_SIZE && cameraCoords.z >= 0 &&
+                cameraCoords.z < WORLD_SIZE;
+    if (cull) {
+        chunkReachable.assign(WORLD_SIZE_CUBED, false);
+        TraverseVisibleChunks(
+            WORLD_SIZE, cameraCoords.x, cameraCoords.y, cameraCoords.z,
+            [&](int x, int y, int z) {
+                // chunks without a mesh yet could be anything, treat them
+                // as open
+                Chunk *chunk = getChunk(x, y, z);
+                if (chunk == nullptr || !chunk->isSetup()) {
+                    return ALL_FACES_CONNECTED;
+                }
+                return chunk->faceConnectivity;
+            },
+            [&](int x, int y, int z) {
+                return inView(glm::vec3(x, y, z) * chunkWorldSize -
+                              glm::vec3(halfWorldSize));
+            },
+            [&](int x, int y, int z) {
+                chunkReachable[getChunkIndex(x, y, z)] = true;
+            });
+    }
+
     // Clear the render list each frame BEFORE we do our tests to see what
     // chunks should be rendered
     chunkRenderList.clear();
+    caveCulledCount = 0;
     ChunkList::iterator iterator;
     for (iterator = chunkVisibilityList.begin();
          iterator != chunkVisibilityList.end(); ++iterator) {
         Chunk *pChunk = (*iterator);
         if (pChunk != NULL) {
             if (pChunk->isLoaded() && pChunk->isSetup()) {
-
-                std::pair<glm::vec3, glm::vec3> chunkRange =
-                    GetChunkRenderRange(newCameraPosition);
-                glm::vec3 start = chunkRange.first;
-                glm::vec3 end = chunkRange.second;
-                if (((start.x <= pChunk->chunkPosition.x &&
-                      pChunk->chunkPosition.x <= end.x) &&
-                     (start.y <= pChunk->chunkPosition.y &&
-                      pChunk->chunkPosition.y <= end.y) &&
-                     (start.z <= pChunk->chunkPosition.z &&
-                      pChunk->chunkPosition.z <= end.z))) {
-
-                    constexpr glm::vec3 offset = glm::vec3(
-                        (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2,
-                        (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2,
-                        (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2);
-                    glm::vec3 chunkCenter = pChunk->chunkPosition + offset;
-
-                    if (!frustum.CubeInFrustum(
-                            chunkCenter,
-                            (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2,
-                            (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2,
-                            (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) /
-                                2)) {
+                if (!inView(pChunk->chunkPosition)) {
+                    continue;
+                }
+                if (cull) {
+                    glm::ivec3 coords = getChunkCoords(pChunk);
+                    if (!chunkReachable[getChunkIndex(coords.x, coords.y,
+                                                      coords.z)]) {
+                        caveCulledCount++;
                         continue;
                     }
-                    chunkRenderList.push_back(pChunk);
-                    // delete pChunk;
                 }
-                // chunkRenderList.push_back(pChunk);
+                chunkRenderList.push_back(pChunk);
             }
         }
     }
 }
 
+// rasterize the nearest chunks' solid bottoms on the CPU and drop the
+// chunks in the render list that are completely behind them
+void ChunkManager::updateOcclusionCulling(Camera newCamera) {
+    occlusionTestedCount = 0;
+    occlusionCulledCount = 0;
+    if (!occlusionCulling) {
+        return;
+    }
+
+    // the mesh is drawn half a block below chunkPosition
+    constexpr float chunkWorldSize =
+        Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+    constexpr glm::vec3 meshOffset = glm::vec3(-Block::BLOCK_RENDER_SIZE / 2.0f);
+
+    ChunkList occluderChunks;
+    for (Chunk *chunk : chunkRenderList) {
+        if (chunk->solidLayers > 0) {
+            occluderChunks.push_back(chunk);
+        }
+    }
+    auto distanceSq = [&](Chunk *chunk) {
+        glm::vec3 d = chunk->chunkPosition + glm::vec3(chunkWorldSize / 2) -
+                      newCamera.cameraPos;
+        return glm::dot(d, d);
+    };
+    if ((int)occluderChunks.size() > MAX_OCCLUDERS) {
+        std::nth_element(occluderChunks.begin(),
+                         occluderChunks.begin() + MAX_OCCLUDERS,
+                         occluderChunks.end(), [&](Chunk *a, Chunk *b) {
+                             return distanceSq(a) < distanceSq(b);
+                         });
+        occluderChunks.resize(MAX_OCCLUDERS);
+    }
+
+    // merge runs of neighbours along x with the same solid height into one
+    // box, less to rasterize and no seams between them
+    std::sort(occluderChunks.begin(), occluderChunks.end(),
+              [](Chunk *a, Chunk *b) {
+                  const glm::vec3 &pa = a->chunkPosition;
+                  const glm::vec3 &pb = b->chunkPosition;
+                  if (pa.y != pb.y) return pa.y < pb.y;
+                  if (pa.z != pb.z) return pa.z < pb.z;
+                  return pa.x < pb.x;
+              });
+    std::vector<OcclusionBox> occluders;
+    Chunk *previous = nullptr;
+    for (Chunk *chunk : occluderChunks) {
+        glm::vec3 min = chunk->chunkPosition + meshOffset;
+        glm::vec3 max =
+            min + glm::vec3(chunkWorldSize,
+                            chunk->solidLayers * Block::BLOCK_RENDER_SIZE,
+                            chunkWorldSize);
+        if (previous != nullptr &&
+            previous->chunkPosition.y == chunk->chunkPosition.y &&
+            previous->chunkPosition.z == chunk->chunkPosition.z &&
+            previous->solidLayers == chunk->solidLayers &&
+            occluders.back().max.x == min.x) {
+            occluders.back().max.x = max.x;
+        } else {
+            occluders.push_back({min, max});
+        }
+        previous = chunk;
+    }
+
+    glm::mat4 projection =
+        glm::perspective(glm::radians(newCamera.fov),
+                         (float)SCR_WIDTH / SCR_HEIGHT, newCamera.zNear,
+                         newCamera.zFar);
+    glm::mat4 view = glm::lookAt(newCamera.cameraPos,
+                                 newCamera.cameraPos + newCamera.cameraFront,
+                                 newCamera.cameraUp);
+    occlusionBuffer.render(occluders, projection * view, newCamera.cameraPos,
+                           newCamera.zNear);
+
+    size_t kept = 0;
+    for (Chunk *chunk : chunkRenderList) {
+        glm::vec3 min = chunk->chunkPosition + meshOffset;
+        OcclusionBox bounds = {min, min + glm::vec3(chunkWorldSize)};
+        occlusionTestedCount++;
+        if (occlusionBuffer.isOccluded(bounds)) {
+            occlusionCulledCount++;
+            continue;
+        }
+        chunkRenderList[kept++] = chunk;
+    }
+    chunkRenderList.resize(kept);
+}
+
+// pick the level of detail of every chunk from its distance to the camera,
+// chunks whose level changed get remeshed
+void ChunkManager::updateLodList(glm::vec3 newCameraPosition) {
+    constexpr float chunkWorldSize =
+        Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+    for (Chunk *chunk : chunkVisibilityList) {
+        // the stream workers read the level of chunks they haven't meshed
+        if (streaming && !chunk->isSetup()) {
+            continue;
+        }
+        glm::vec3 chunkCenter =
+            chunk->chunkPosition + glm::vec3(chunkWorldSize / 2);
+        float distance =
+            glm::length(chunkCenter - newCameraPosition) / chunkWorldSize;
+        chunk->targetLodLevel = SelectLodLevel(chunk->targetLodLevel, distance);
+        if (chunk->isSetup() && chunk->targetLodLevel != chunk->lodLevel) {
+            QueueChunkToRebuild(chunk);
+        }
+    }
+}
+
 void ChunkManager::updateVisibilityList(glm::vec3 newCameraPosition) {
     for (Chunk *chunk : chunkVisibilityList) {
         chunkLoadList.push_back(chunk);
@@ -504,10 +1099,28 @@ void ChunkManager::updateVisibilityList(glm::vec3 newCameraPosition) {
     }
 }
 
+// draws the render queue: opaque meshes front-to-back with blending off,
+// then water back-to-front with blending on and depth writes off
 void ChunkManager::render(Camera newCamera) {
-    for (Chunk *chunk : chunkRenderList) {
-        chunk->render(newCamera);
+    PROFILE_SCOPE("render chunks");
+    int pass = -1;
+    for (const RenderItem &item : renderQueue.items) {
+        // only touch GL state when the pass changes
+        if (RenderQueue::getPass(item.key) != pass) {
+            pass = RenderQueue::getPass(item.key);
+            if (pass == RenderQueue::PASS_OPAQUE) {
+                glDisable(GL_BLEND);
+                glDepthMask(GL_TRUE);
+            } else {
+                glEnable(GL_BLEND);
+                glDepthMask(GL_FALSE);
+            }
+        }
+        item.chunk->render(newCamera, pass == RenderQueue::PASS_TRANSLUCENT);
     }
+    // glClear only clears depth while depth writes are on
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
 }
 
 #endif // CHUNK_MANAGER
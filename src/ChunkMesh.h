@@ -33,15 +33,16 @@ struct ChunkMesh {
 
     int *vertices;
     /*
-            Represents vertex data by packing them into a 32-bit float:
-            [start]...ttttttfffzzzzzzyyyyyyxxxxxx[end]
+            Represents vertex data by packing them into a 32-bit int:
+            [start]..aavvvvvuuuuufffzzzzzyyyyyxxxxx[end]
             where:
-            - x, y, z: represent bits occupied to represent vertex position
-   within a chunk
+            - x, y, z: block corner of the vertex within the chunk
             - f: bits occupied to represent the vertex's face's normal vector
-            - t: block type ID
+            - u, v: texture atlas coordinate
+            - a: baked ambient occlusion level
     */
     unsigned int *indices; // Vertex indices (in case vertex data comes indexed)
+    size_t cpuBytes;       // malloc'd for vertices + indices, see MemoryStats.h
 
     // OpenGL identifiers
     unsigned int vaoId; // OpenGL Vertex Array Object id
@@ -116,13 +117,17 @@ void UploadChunkMesh(ChunkMesh *mesh, bool dynamic) {
 // Unload mesh from memory (RAM and VRAM)
 void UnloadChunkMesh(ChunkMesh mesh) {
     // Unload rlgl mesh vboId data
-    smolUnloadVertexArray(mesh.vaoId);
+    // empty meshes are never uploaded
+    if (mesh.vaoId > 0)
+        smolUnloadVertexArray(mesh.vaoId);
 
     if (mesh.vboId != NULL)
         for (int i = 0; i < ChunkMesh::MESH_VERTEX_BUFFERS; i++)
-            glDeleteBuffers(1, &(mesh.vboId[i]));
+            smolUnloadBuffer(mesh.vboId[i]);
     free(mesh.vboId);
 
+    if (mesh.cpuBytes > 0)
+        MemoryStats::remove(MEM_MESH_CPU, mesh.cpuBytes);
     free(mesh.vertices);
     free(mesh.indices);
 }
@@ -0,0 +1,179 @@
+#ifndef CHUNKVISIBILITY_H
+#define CHUNKVISIBILITY_H
+
+#include "Block.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Connectivity based occlusion culling, for caves and everything else
+    under the surface.
+
+    At mesh time every chunk flood fills its see-through cells (air and
+    water) and records which of its 6 faces can see each other through
+    them, as a 6x6 bit matrix.
+    At render time a breadth first search starts in the camera's chunk and
+    only steps from a chunk into its neighbour through a face that is
+    connected to the face it entered by. It never steps back towards the
+    camera, and only into chunks inside the frustum. Chunks it doesn't
+    reach can't be seen.
+
+    Nothing here touches OpenGL, so it can run headless.
+*/
+
+enum ChunkFace {
+    FACE_NEG_X = 0,
+    FACE_POS_X,
+    FACE_NEG_Y,
+    FACE_POS_Y,
+    FACE_NEG_Z,
+    FACE_POS_Z,
+    NUM_CHUNK_FACES,
+};
+
+static constexpr int CHUNK_FACE_DIRS[NUM_CHUNK_FACES][3] = {
+    {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1},
+};
+
+// every face sees every other face, used for empty chunks and chunks that
+// haven't been meshed yet
+static constexpr uint64_t ALL_FACES_CONNECTED = (1ull << 36) - 1;
+
+inline int OppositeFace(int face) { return face ^ 1; }
+
+inline bool FacesConnected(uint64_t connectivity, int a, int b) {
+    return (connectivity >> (a * NUM_CHUNK_FACES + b)) & 1;
+}
+
+// 6x6 face connectivity of a size^3 block array
+inline uint64_t ComputeFaceConnectivity(const Block *blocks, int size) {
+    int cellCount = size * size * size;
+    std::vector<bool> visited(cellCount, false);
+    std::vector<int> stack;
+    stack.reserve(cellCount);
+    uint64_t connectivity = 0;
+
+    auto seeThrough = [&](int i) {
+        return !blocks[i].isActive || blocks[i].isTranslucent();
+    };
+
+    for (int start = 0; start < cellCount; start++) {
+        if (visited[start] || !seeThrough(start)) {
+            continue;
+        }
+
+        // flood fill one air pocket, collecting the faces it touches
+        int faces = 0;
+        visited[start] = true;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int i = stack.back();
+            stack.pop_back();
+            int x = i % size;
+            int y = (i / size) % size;
+            int z = i / (size * size);
+
+            if (x == 0) faces |= 1 << FACE_NEG_X;
+            if (x == size - 1) faces |= 1 << FACE_POS_X;
+            if (y == 0) faces |= 1 << FACE_NEG_Y;
+            if (y == size - 1) faces |= 1 << FACE_POS_Y;
+            if (z == 0) faces |= 1 << FACE_NEG_Z;
+            if (z == size - 1) faces |= 1 << FACE_POS_Z;
+
+            for (int f = 0; f < NUM_CHUNK_FACES; f++) {
+                int nx = x + CHUNK_FACE_DIRS[f][0];
+                int ny = y + CHUNK_FACE_DIRS[f][1];
+                int nz = z + CHUNK_FACE_DIRS[f][2];
+                if (nx < 0 || nx >= size || ny < 0 || ny >= size || nz < 0 ||
+                    nz >= size) {
+                    continue;
+                }
+                int n = nx + ny * size + nz * size * size;
+                if (!visited[n] && seeThrough(n)) {
+                    visited[n] = true;
+                    stack.push_back(n);
+                }
+            }
+        }
+
+        for (int a = 0; a < NUM_CHUNK_FACES; a++) {
+            if (!(faces & (1 << a))) {
+                continue;
+            }
+            for (int b = 0; b < NUM_CHUNK_FACES; b++) {
+                if (faces & (1 << b)) {
+                    connectivity |= 1ull << (a * NUM_CHUNK_FACES + b);
+                }
+            }
+        }
+        if (connectivity == ALL_FACES_CONNECTED) {
+            break;
+        }
+    }
+    return connectivity;
+}
+
+/*
+    Breadth first search over a worldSize^3 grid of chunks, starting at
+    (startX, startY, startZ).
+    getConnectivity(x, y, z) -> uint64_t face connectivity of a chunk
+    isVisible(x, y, z)       -> bool, frustum and render range test
+    visit(x, y, z)           -> called once for every chunk reached
+    Returns the number of chunks visited.
+*/
+template <typename GetConnectivity, typename IsVisible, typename Visit>
+int TraverseVisibleChunks(int worldSize, int startX, int startY, int startZ,
+                          GetConnectivity getConnectivity, IsVisible isVisible,
+                          Visit visit) {
+    struct Step {
+        int x, y, z;
+        int entryFace; // face we came in through, -1 for the camera chunk
+        int dirMask;   // directions travelled so far
+    };
+
+    std::vector<bool> visited(worldSize * worldSize * worldSize, false);
+    std::vector<Step> queue;
+    auto index = [&](int x, int y, int z) {
+        return x + y * worldSize + z * worldSize * worldSize;
+    };
+
+    visited[index(startX, startY, startZ)] = true;
+    queue.push_back({startX, startY, startZ, -1, 0});
+    visit(startX, startY, startZ);
+
+    for (size_t head = 0; head < queue.size(); head++) {
+        Step step = queue[head];
+        uint64_t connectivity = getConnectivity(step.x, step.y, step.z);
+
+        for (int f = 0; f < NUM_CHUNK_FACES; f++) {
+            // never head back towards the camera
+            if (step.dirMask & (1 << OppositeFace(f))) {
+                continue;
+            }
+            if (step.entryFace != -1 &&
+                !FacesConnected(connectivity, step.entryFace, f)) {
+                continue;
+            }
+
+            int nx = step.x + CHUNK_FACE_DIRS[f][0];
+            int ny = step.y + CHUNK_FACE_DIRS[f][1];
+            int nz = step.z + CHUNK_FACE_DIRS[f][2];
+            if (nx < 0 || nx >= worldSize || ny < 0 || ny >= worldSize ||
+                nz < 0 || nz >= worldSize) {
+                continue;
+            }
+            if (visited[index(nx, ny, nz)] || !isVisible(nx, ny, nz)) {
+                continue;
+            }
+
+            visited[index(nx, ny, nz)] = true;
+            queue.push_back({nx, ny, nz, OppositeFace(f), step.dirMask | (1 << f)});
+            visit(nx, ny, nz);
+        }
+    }
+    return (int)queue.size();
+}
+
+#endif // CHUNKVISIBILITY_H
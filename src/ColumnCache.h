@@ -0,0 +1,81 @@
+#ifndef COLUMNCACHE_H
+#define COLUMNCACHE_H
+
+#include "MemoryStats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+/*
+    Per column data of a terrain generator (heightmaps and such), keyed by
+    the chunk's x/z, so the vertically stacked chunks of a column compute it
+    once between them.
+
+        std::shared_ptr<const Heights> heights =
+            cache.get(chunkX, chunkZ, [&](Heights &h) { ...fill h... });
+
+    Safe to call from any thread. The fill runs outside the lock, two
+    threads asking for the same new column may both fill it and the first
+    one to finish is kept. The least recently used columns are dropped once
+    there are more than capacity, anyone still holding one keeps it alive.
+*/
+
+template <typename T> struct ColumnCache {
+    explicit ColumnCache(size_t _capacity) : capacity(_capacity) {}
+    ~ColumnCache() {
+        for (size_t i = 0; i < entries.size(); i++) {
+            MemoryStats::remove(MEM_GENERATOR_CACHE, sizeof(T));
+        }
+    }
+
+    template <typename Fill>
+    std::shared_ptr<const T> get(int x, int z, Fill fill) {
+        uint64_t key = ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end()) {
+                order.splice(order.begin(), order, it->second.second);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return it->second.first;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+
+        std::shared_ptr<T> value = std::make_shared<T>();
+        fill(*value);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            return it->second.first; // someone else was faster
+        }
+        order.push_front(key);
+        entries.emplace(key, std::make_pair(value, order.begin()));
+        MemoryStats::add(MEM_GENERATOR_CACHE, sizeof(T));
+        while (entries.size() > capacity) {
+            entries.erase(order.back());
+            order.pop_back();
+            MemoryStats::remove(MEM_GENERATOR_CACHE, sizeof(T));
+        }
+        return value;
+    }
+
+    size_t capacity;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+  private:
+    std::mutex mutex;
+    std::list<uint64_t> order; // most recently used first
+    std::unordered_map<uint64_t, std::pair<std::shared_ptr<const T>,
+                                           std::list<uint64_t>::iterator>>
+        entries;
+};
+
+#endif // COLUMNCACHE_H
@@ -0,0 +1,337 @@
+#ifndef DECORATIONS_H
+#define DECORATIONS_H
+
+#include "Chunk.h"
+#include "MemoryStats.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Second generation phase: features bigger than a block (trees, boulders)
+    that may reach into the neighbouring chunks.
+
+        generate terrain of a chunk (any thread)
+        decorations.decorate(chunk)  (same thread)
+
+    decorate() picks the chunk's features from a hash of its coordinates
+    (Random.h), so they're the same whatever thread or order chunks come in,
+    and writes their blocks. Blocks for chunks that haven't been decorated
+    yet wait in that chunk's pending list and are put in when it is,
+    blocks for chunks that have been go straight in, and the chunk is
+    remembered (takeTouched) so the chunk manager can remesh it if it was
+    already meshed.
+
+    Chunks are spread over NUM_STRIPES locks by their coordinates, a write
+    only locks the stripe of the chunk it goes into, no lock covers the
+    whole world.
+
+    Where two writes hit the same block the higher FeaturePriority wins,
+    terrain is never replaced by wood or leaves, so the end result doesn't
+    depend on which write came first either.
+*/
+
+// air < leaves < wood < everything else (terrain, boulders)
+inline int FeaturePriority(const Block &block) {
+    if (!block.isActive) {
+        return 0;
+    }
+    switch (block.blockType) {
+    case BlockType::Leaves:
+        return 1;
+    case BlockType::Wood:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+struct DecorationPass {
+    static constexpr int NUM_STRIPES = 64;
+    static constexpr int SPOTS_PER_CHUNK = 4; // candidate feature spots
+    static constexpr int TREE_CHANCE = 12;    // percent per spot
+    static constexpr int BOULDER_CHANCE = 3;
+    static constexpr int MIN_TREE_HEIGHT = 3;
+    static constexpr uint32_t RANDOM_STREAM = 2; // 0 and 1 are the terrain's
+
+    // maxBlockY: top block of the world, nothing is written above it
+    DecorationPass(int _seed, int _maxBlockY) : seed(_seed), maxBlockY(_maxBlockY) {}
+    ~DecorationPass();
+
+    void decorate(Chunk *chunk);
+    // a chunk that already has its features (loaded from disk): it places
+    // none, and what the neighbours write into it is dropped
+    void skip(Chunk *chunk);
+    // chunks written to after they were decorated, since the last call
+    std::vector<Chunk *> takeTouched();
+
+    // for stats and voxel-bench
+    std::atomic<uint64_t> featuresPlaced{0};
+    std::atomic<uint64_t> pendingWrites{0}; // blocks that had to wait
+    std::atomic<uint64_t> directWrites{0};  // blocks into decorated neighbours
+
+  private:
+    struct FeatureBlock {
+        int x, y, z; // world block coordinates
+        BlockType type;
+    };
+    struct PendingWrite {
+        uint16_t index;
+        BlockType type;
+    };
+    struct ChunkSlot {
+        Chunk *chunk = nullptr; // set once decorated
+        bool skipped = false;
+        std::vector<PendingWrite> pending;
+    };
+    struct Stripe {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, ChunkSlot> slots;
+        std::vector<Chunk *> touched;
+    };
+
+    int seed;
+    int maxBlockY;
+    Stripe stripes[NUM_STRIPES];
+
+    static int floorDiv(int a, int b) { return (int)std::floor((float)a / b); }
+
+    static uint64_t slotKey(const Chunk *chunk) {
+        constexpr int size = Chunk::CHUNK_SIZE;
+        glm::vec3 position = chunk->generatorPosition();
+        return chunkKey(floorDiv((int)position.x, size), floorDiv((int)position.y, size),
+                        floorDiv((int)position.z, size));
+    }
+
+    static uint64_t chunkKey(int x, int y, int z) {
+        return ((uint64_t)(x & 0x1FFFFF) << 42) | ((uint64_t)(y & 0x1FFFFF) << 21) |
+               (uint64_t)(z & 0x1FFFFF);
+    }
+
+    Stripe &stripeOf(uint64_t key) { return stripes[SplitMix64(key) % NUM_STRIPES]; }
+
+    // true if it changed the block
+    static bool apply(Block &block, BlockType type) {
+        Block written;
+        written.isActive = true;
+        written.blockType = type;
+        if (FeaturePriority(written) <= FeaturePriority(block)) {
+            return false;
+        }
+        block = written;
+        return true;
+    }
+
+    void placeTree(int x, int y, int z, int height, std::vector<FeatureBlock> &out);
+    void placeBoulder(int x, int y, int z, std::vector<FeatureBlock> &out);
+    void write(std::vector<FeatureBlock> &blocks, const Chunk *self);
+};
+
+DecorationPass::~DecorationPass() {
+    for (Stripe &stripe : stripes) {
+        for (auto &slot : stripe.slots) {
+            if (!slot.second.pending.empty()) {
+                MemoryStats::remove(MEM_GENERATOR_CACHE,
+                                    slot.second.pending.size() * sizeof(PendingWrite));
+            }
+        }
+    }
+}
+
+// trunk from the block above the grass at x/y/z, leaves around its top
+void DecorationPass::placeTree(int x, int y, int z, int height,
+                               std::vector<FeatureBlock> &out) {
+    int top = y + height;
+    for (int ty = y + 1; ty <= top; ty++) {
+        out.push_back({x, ty, z, BlockType::Wood});
+    }
+    for (int ly = top - 2; ly <= top + 1; ly++) {
+        int radius = ly < top ? 2 : 1;
+        for (int dz = -radius; dz <= radius; dz++) {
+            for (int dx = -radius; dx <= radius; dx++) {
+                bool corner = std::abs(dx) == radius && std::abs(dz) == radius;
+                if (corner && (radius == 2 || ly == top + 1)) {
+                    continue;
+                }
+                out.push_back({x + dx, ly, z + dz, BlockType::Leaves});
+            }
+        }
+    }
+}
+
+// a small lump of stone sitting on the grass at x/y/z
+void DecorationPass::placeBoulder(int x, int y, int z, std::vector<FeatureBlock> &out) {
+    for (int dy = 1; dy <= 2; dy++) {
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dy == 2 && dx != 0 && dz != 0) {
+                    continue;
+                }
+                out.push_back({x + dx, y + dy, z + dz, BlockType::Stone});
+            }
+        }
+    }
+}
+
+void DecorationPass::decorate(Chunk *chunk) {
+    constexpr int size = Chunk::CHUNK_SIZE;
+    glm::vec3 position = chunk->generatorPosition();
+    int baseX = (int)position.x, baseY = (int)position.y, baseZ = (int)position.z;
+    int chunkX = floorDiv(baseX, size), chunkY = floorDiv(baseY, size),
+        chunkZ = floorDiv(baseZ, size);
+
+    // pick features from this chunk's own terrain. Nobody else writes to
+    // its blocks until it's in its slot below
+    std::vector<FeatureBlock> features;
+    uint64_t random = ChunkRandomKey(seed, chunkX, chunkY, chunkZ, RANDOM_STREAM);
+    for (int spot = 0; spot < SPOTS_PER_CHUNK; spot++) {
+        uint32_t roll = RandomRange(random, spot * 4, 100);
+        if (roll >= TREE_CHANCE + BOULDER_CHANCE) {
+            continue;
+        }
+        int x = RandomRange(random, spot * 4 + 1, size);
+        int z = RandomRange(random, spot * 4 + 2, size);
+        // the top block of the column in this chunk, if it's grass.
+        // Generators only put grass under air
+        int y = size - 1;
+        while (y >= 0 && !chunk->blocks[chunk->getIndex(x, y, z)].isActive) {
+            y--;
+        }
+        if (y < 0 || chunk->blocks[chunk->getIndex(x, y, z)].blockType != BlockType::Grass) {
+            continue;
+        }
+        // trees near the top of the world come out shorter
+        int room = maxBlockY - (baseY + y);
+        if (roll < TREE_CHANCE) {
+            int height = std::min(4 + (int)RandomRange(random, spot * 4 + 3, 3), room);
+            if (height < MIN_TREE_HEIGHT) {
+                continue;
+            }
+            placeTree(baseX + x, baseY + y, baseZ + z, height, features);
+        } else {
+            if (room < 2) {
+                continue;
+            }
+            placeBoulder(baseX + x, baseY + y, baseZ + z, features);
+        }
+        featuresPlaced.fetch_add(1, std::memory_order_relaxed);
+    }
+    // and lose the leaves that would stick out of it
+    features.erase(std::remove_if(features.begin(), features.end(),
+                                  [&](const FeatureBlock &block) {
+                                      return block.y > maxBlockY;
+                                  }),
+                   features.end());
+
+    // take in what the neighbours left for this chunk, from now on their
+    // writes come straight in
+    uint64_t key = slotKey(chunk);
+    Stripe &stripe = stripeOf(key);
+    {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        ChunkSlot &slot = stripe.slots[key];
+        for (const PendingWrite &pending : slot.pending) {
+            apply(chunk->blocks[pending.index], pending.type);
+        }
+        if (!slot.pending.empty()) {
+            MemoryStats::remove(MEM_GENERATOR_CACHE,
+                                slot.pending.size() * sizeof(PendingWrite));
+        }
+        slot.pending = std::vector<PendingWrite>();
+        slot.chunk = chunk;
+    }
+
+    write(features, chunk);
+}
+
+void DecorationPass::skip(Chunk *chunk) {
+    uint64_t key = slotKey(chunk);
+    Stripe &stripe = stripeOf(key);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    ChunkSlot &slot = stripe.slots[key];
+    if (!slot.pending.empty()) {
+        MemoryStats::remove(MEM_GENERATOR_CACHE,
+                            slot.pending.size() * sizeof(PendingWrite));
+    }
+    slot.pending = std::vector<PendingWrite>();
+    slot.skipped = true;
+}
+
+void DecorationPass::write(std::vector<FeatureBlock> &blocks, const Chunk *self) {
+    constexpr int size = Chunk::CHUNK_SIZE;
+    auto keyOf = [&](const FeatureBlock &block) {
+        return chunkKey(floorDiv(block.x, size), floorDiv(block.y, size),
+                        floorDiv(block.z, size));
+    };
+    // one lock per chunk written to, not per block
+    std::sort(blocks.begin(), blocks.end(),
+              [&](const FeatureBlock &a, const FeatureBlock &b) {
+                  return keyOf(a) < keyOf(b);
+              });
+
+    for (size_t start = 0; start < blocks.size();) {
+        uint64_t key = keyOf(blocks[start]);
+        size_t end = start;
+        while (end < blocks.size() && keyOf(blocks[end]) == key) {
+            end++;
+        }
+
+        Stripe &stripe = stripeOf(key);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        ChunkSlot &slot = stripe.slots[key];
+        if (slot.skipped) {
+            start = end;
+            continue;
+        }
+        bool changed = false;
+        size_t pendingBefore = slot.pending.size();
+        for (size_t i = start; i < end; i++) {
+            const FeatureBlock &block = blocks[i];
+            int x = block.x - floorDiv(block.x, size) * size;
+            int y = block.y - floorDiv(block.y, size) * size;
+            int z = block.z - floorDiv(block.z, size) * size;
+            uint16_t index = (uint16_t)(x + y * size + z * size * size);
+            if (slot.chunk != nullptr) {
+                changed = apply(slot.chunk->blocks[index], block.type) || changed;
+            } else {
+                slot.pending.push_back({index, block.type});
+            }
+        }
+        // a slot's pending list counts as one allocation
+        if (pendingBefore == 0 && !slot.pending.empty()) {
+            MemoryStats::add(MEM_GENERATOR_CACHE,
+                             slot.pending.size() * sizeof(PendingWrite));
+        } else if (slot.pending.size() > pendingBefore) {
+            MemoryStats::resize(MEM_GENERATOR_CACHE,
+                                pendingBefore * sizeof(PendingWrite),
+                                slot.pending.size() * sizeof(PendingWrite));
+        }
+        if (slot.chunk != nullptr && slot.chunk != self) {
+            directWrites.fetch_add(end - start, std::memory_order_relaxed);
+            if (changed) {
+                stripe.touched.push_back(slot.chunk);
+            }
+        } else if (slot.chunk == nullptr) {
+            pendingWrites.fetch_add(end - start, std::memory_order_relaxed);
+        }
+        start = end;
+    }
+}
+
+std::vector<Chunk *> DecorationPass::takeTouched() {
+    std::vector<Chunk *> touched;
+    for (Stripe &stripe : stripes) {
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        touched.insert(touched.end(), stripe.touched.begin(), stripe.touched.end());
+        stripe.touched.clear();
+    }
+    return touched;
+}
+
+#endif // DECORATIONS_H
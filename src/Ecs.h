@@ -11,6 +11,7 @@
 
 #include "Component.h"
 #include "ChunkManager.h"
+#include "MemoryStats.h"
 
 using Entity = std::uint32_t;
 const Entity MAX_ENTITIES = 5000;
@@ -71,11 +72,19 @@ struct EntityManager {
 
 struct IComponentArray {
   public:
-    ~IComponentArray() = default;
-    void EntityDestroyed(Entity entity);
+    virtual ~IComponentArray() = default;
+    virtual void EntityDestroyed(Entity entity) = 0;
 };
 
 template <typename T> struct ComponentArray : public IComponentArray {
+    ComponentArray() {
+        MemoryStats::add(MEM_ECS, sizeof(mComponentArray));
+    }
+
+    ~ComponentArray() {
+        MemoryStats::remove(MEM_ECS, sizeof(mComponentArray));
+    }
+
     void InsertData(Entity entity, T component) {
         assert(mEntityToIndexMap.find(entity) == mEntityToIndexMap.end() &&
                "Component added to same entity more than once.");
@@ -117,7 +126,7 @@ template <typename T> struct ComponentArray : public IComponentArray {
         return mComponentArray[mEntityToIndexMap[entity]];
     }
 
-    void EntityDestroyed(Entity entity) {
+    void EntityDestroyed(Entity entity) override {
         if (mEntityToIndexMap.find(entity) != mEntityToIndexMap.end()) {
             // Remove the entity's component if it existed
             RemoveData(entity);
@@ -137,7 +146,7 @@ template <typename T> struct ComponentArray : public IComponentArray {
     std::unordered_map<size_t, Entity> mIndexToEntityMap;
 
     // Total size of valid entries in the array.
-    size_t mSize;
+    size_t mSize = 0;
 };
 
 struct ComponentManager {
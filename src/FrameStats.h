@@ -0,0 +1,152 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+    Frame time statistics, every frame goes in, nothing is averaged away.
+
+    Frame times are kept in microseconds in a log-linear histogram (like
+    HdrHistogram): exact below 128us, then every power of two is split in
+    64 buckets, so any value is off by less than 1/64 (1.6%). That covers
+    1us to over an hour in a couple of thousand counters, and percentiles
+    are a walk over them.
+    The last HISTORY frames are also kept as they are for the plot.
+*/
+
+struct FrameStats {
+    static constexpr int LINEAR_BUCKETS = 128;
+    static constexpr int SUB_BUCKETS = 64; // per power of two above that
+    static constexpr int MAX_EXPONENT = 32;
+    static constexpr int NUM_BUCKETS =
+        LINEAR_BUCKETS + (MAX_EXPONENT - 7) * SUB_BUCKETS;
+    static constexpr int HISTORY = 512;
+
+    // hitch thresholds, a missed frame at 60 and 30 Hz
+    static constexpr double SLOW_FRAME_MS = 16.6;
+    static constexpr double VERY_SLOW_FRAME_MS = 33.3;
+
+    uint64_t counts[NUM_BUCKETS] = {0};
+    uint64_t frames = 0;
+    uint64_t slowFrames = 0;
+    uint64_t verySlowFrames = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    float history[HISTORY] = {0}; // ms, ring buffer
+    int historyOffset = 0;        // oldest entry, for ImGui::PlotLines
+
+    void record(double ms);
+    double percentile(double p) const;
+    double meanMs() const { return frames > 0 ? totalMs / frames : 0.0; }
+    void reset();
+    bool exportCsv(const std::string &path) const;
+
+    static int bucketIndex(uint64_t us);
+    static uint64_t bucketLow(int index);
+    static uint64_t bucketHigh(int index); // exclusive
+};
+
+int FrameStats::bucketIndex(uint64_t us) {
+    if (us < LINEAR_BUCKETS) {
+        return (int)us;
+    }
+    int msb = 7;
+    while (msb < 63 && (us >> (msb + 1)) != 0) {
+        msb++;
+    }
+    if (msb >= MAX_EXPONENT) {
+        return NUM_BUCKETS - 1;
+    }
+    int shift = msb - 6; // keep the top 7 bits, the first is always set
+    int sub = (int)(us >> shift) - SUB_BUCKETS;
+    return LINEAR_BUCKETS + (msb - 7) * SUB_BUCKETS + sub;
+}
+
+uint64_t FrameStats::bucketLow(int index) {
+    if (index < LINEAR_BUCKETS) {
+        return index;
+    }
+    int msb = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 7;
+    int sub = (index - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return (uint64_t)sub << (msb - 6);
+}
+
+uint64_t FrameStats::bucketHigh(int index) {
+    if (index < LINEAR_BUCKETS) {
+        return index + 1;
+    }
+    int msb = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 7;
+    return bucketLow(index) + (1ull << (msb - 6));
+}
+
+void FrameStats::record(double ms) {
+    uint64_t us = (uint64_t)std::max(0.0, ms * 1000.0);
+    counts[bucketIndex(us)]++;
+    frames++;
+    totalMs += ms;
+    maxMs = std::max(maxMs, ms);
+    if (ms > SLOW_FRAME_MS) {
+        slowFrames++;
+    }
+    if (ms > VERY_SLOW_FRAME_MS) {
+        verySlowFrames++;
+    }
+
+    history[historyOffset] = (float)ms;
+    historyOffset = (historyOffset + 1) % HISTORY;
+}
+
+// frame time (ms) that p (0-1) of the frames were at or under, reported as
+// the middle of its bucket
+double FrameStats::percentile(double p) const {
+    if (frames == 0) {
+        return 0.0;
+    }
+    uint64_t target = std::max<uint64_t>(1, (uint64_t)(p * frames + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            double mid = (bucketLow(i) + bucketHigh(i) - 1) / 2.0 / 1000.0;
+            return std::min(mid, maxMs);
+        }
+    }
+    return maxMs;
+}
+
+void FrameStats::reset() { *this = FrameStats(); }
+
+// summary first, then every non-empty bucket, so two runs can be diffed
+bool FrameStats::exportCsv(const std::string &path) const {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    std::fprintf(file, "metric,value\n");
+    std::fprintf(file, "frames,%llu\n", (unsigned long long)frames);
+    std::fprintf(file, "mean_ms,%.4f\n", meanMs());
+    std::fprintf(file, "p50_ms,%.4f\n", percentile(0.50));
+    std::fprintf(file, "p95_ms,%.4f\n", percentile(0.95));
+    std::fprintf(file, "p99_ms,%.4f\n", percentile(0.99));
+    std::fprintf(file, "max_ms,%.4f\n", maxMs);
+    std::fprintf(file, "over_16_6ms,%llu\n", (unsigned long long)slowFrames);
+    std::fprintf(file, "over_33_3ms,%llu\n",
+                 (unsigned long long)verySlowFrames);
+    std::fprintf(file, "\nbucket_low_ms,bucket_high_ms,count\n");
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        std::fprintf(file, "%.3f,%.3f,%llu\n", bucketLow(i) / 1000.0,
+                     bucketHigh(i) / 1000.0, (unsigned long long)counts[i]);
+    }
+    std::fclose(file);
+    return true;
+}
+
+#endif // FRAMESTATS_H
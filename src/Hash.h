@@ -0,0 +1,104 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/*
+    64-bit hash of a byte buffer, for cache keys and checksums (see
+    MeshCache.h). It's XXH64, same output as the reference xxHash, so
+    keys can be checked against any other implementation:
+
+        uint64_t key = Hash64(data, size, seed);
+
+    Four independent lanes over 32 byte stripes, so it runs at memory
+    speed rather than one multiply per byte like FNV. Not for anything
+    adversarial.
+*/
+
+constexpr uint64_t HASH64_PRIME1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t HASH64_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t HASH64_PRIME3 = 0x165667B19E3779F9ull;
+constexpr uint64_t HASH64_PRIME4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t HASH64_PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline uint64_t hashRotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hashRead64(const uint8_t *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hashRead32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hashRound(uint64_t acc, uint64_t input) {
+    acc += input * HASH64_PRIME2;
+    acc = hashRotl(acc, 31);
+    return acc * HASH64_PRIME1;
+}
+
+static inline uint64_t hashMergeRound(uint64_t acc, uint64_t lane) {
+    acc ^= hashRound(0, lane);
+    return acc * HASH64_PRIME1 + HASH64_PRIME4;
+}
+
+uint64_t Hash64(const void *data, size_t size, uint64_t seed = 0) {
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + HASH64_PRIME1 + HASH64_PRIME2;
+        uint64_t v2 = seed + HASH64_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH64_PRIME1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = hashRound(v1, hashRead64(p));
+            v2 = hashRound(v2, hashRead64(p + 8));
+            v3 = hashRound(v3, hashRead64(p + 16));
+            v4 = hashRound(v4, hashRead64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = hashRotl(v1, 1) + hashRotl(v2, 7) + hashRotl(v3, 12) + hashRotl(v4, 18);
+        h = hashMergeRound(h, v1);
+        h = hashMergeRound(h, v2);
+        h = hashMergeRound(h, v3);
+        h = hashMergeRound(h, v4);
+    } else {
+        h = seed + HASH64_PRIME5;
+    }
+    h += (uint64_t)size;
+
+    // the last 0-31 bytes
+    for (; p + 8 <= end; p += 8) {
+        h ^= hashRound(0, hashRead64(p));
+        h = hashRotl(h, 27) * HASH64_PRIME1 + HASH64_PRIME4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)hashRead32(p) * HASH64_PRIME1;
+        h = hashRotl(h, 23) * HASH64_PRIME2 + HASH64_PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * HASH64_PRIME5;
+        h = hashRotl(h, 11) * HASH64_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH64_PRIME2;
+    h ^= h >> 29;
+    h *= HASH64_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+#endif // HASH_H
@@ -0,0 +1,434 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "Camera.h"
+#include "FrameStats.h"
+#include "MemoryStats.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#ifdef VOXEL_EGL
+// the surfaceless platform doesn't need Xlib, keep its macros out
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+    Headless mode for benchmarking on machines without a display or GPU.
+
+    There's no window and no display server, the context comes from:
+    - EGL on Mesa's surfaceless platform (EGL_MESA_platform_surfaceless),
+      with no surface at all. That's the GPU where there is one and
+      llvmpipe otherwise. Needs a build that found libEGL (VOXEL_EGL, see
+      CMakeLists.txt)
+    - otherwise GLFW's null platform with an OSMesa (llvmpipe) context,
+      which needs GLFW 3.4+ and libOSMesa at runtime
+    If neither is there headless mode fails, it never falls back to a
+    window. Frames are rendered into an offscreen framebuffer, the camera
+    follows ScriptedCameraPath and a JSON report is written at the end.
+*/
+
+// a current GL 3.3 core context without a window
+struct HeadlessContext {
+    GLFWwindow *window = nullptr; // OSMesa through GLFW's null platform
+#ifdef VOXEL_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+
+    // width and height only matter to OSMesa, its context has a window size
+    bool create(int width, int height);
+    void destroy();
+    // for gladLoadGLLoader
+    GLADloadproc loader() const;
+
+  private:
+    bool createEgl();
+    bool createOsMesa(int width, int height);
+};
+
+#ifdef VOXEL_EGL
+static void *headlessEglProcAddress(const char *name) {
+    return (void *)eglGetProcAddress(name);
+}
+
+static bool hasEglExtension(const char *extensions, const char *name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+    size_t length = std::strlen(name);
+    for (const char *p = extensions; (p = std::strstr(p, name)) != nullptr;
+         p += length) {
+        if ((p == extensions || p[-1] == ' ') &&
+            (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+bool HeadlessContext::create(int width, int height) {
+    if (createEgl()) {
+        std::printf("headless: EGL surfaceless context\n");
+        return true;
+    }
+    if (createOsMesa(width, height)) {
+        std::printf("headless: OSMesa context\n");
+        return true;
+    }
+    std::printf("headless: no offscreen GL context. Needs EGL with "
+                "EGL_MESA_platform_surfaceless (a build with libEGL), or "
+                "GLFW 3.4+ with OSMesa\n");
+    return false;
+}
+
+bool HeadlessContext::createEgl() {
+#ifdef VOXEL_EGL
+    // client extensions, before there's a display
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (!hasEglExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        return false;
+    }
+    display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                    EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        display = EGL_NO_DISPLAY;
+        return false;
+    }
+    // no surface to make current, the framebuffer is all there is
+    if (!hasEglExtension(eglQueryString(display, EGL_EXTENSIONS),
+                         "EGL_KHR_surfaceless_context") ||
+        !eglBindAPI(EGL_OPENGL_API)) {
+        destroy();
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, EGL_DONT_CARE,
+        EGL_NONE,
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) ||
+        configCount == 0) {
+        destroy();
+        return false;
+    }
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        destroy();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HeadlessContext::createOsMesa(int width, int height) {
+#ifdef GLFW_PLATFORM_NULL
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    if (!glfwInit()) {
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    window = glfwCreateWindow(width, height, "woksol", NULL, NULL);
+    if (window == NULL) {
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void HeadlessContext::destroy() {
+#ifdef VOXEL_EGL
+    if (display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT) {
+            eglDestroyContext(display, context);
+        }
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+    }
+#endif
+    if (window != nullptr) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        window = nullptr;
+    }
+}
+
+GLADloadproc HeadlessContext::loader() const {
+#ifdef VOXEL_EGL
+    if (context != EGL_NO_CONTEXT) {
+        return (GLADloadproc)headlessEglProcAddress;
+    }
+#endif
+    return (GLADloadproc)glfwGetProcAddress;
+}
+
+// colour + depth framebuffer to render into instead of a window
+struct OffscreenTarget {
+    unsigned int fbo = 0;
+    unsigned int colorRbo = 0;
+    unsigned int depthRbo = 0;
+
+    bool create(int width, int height) {
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+        glGenRenderbuffers(1, &colorRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  GL_RENDERBUFFER, colorRbo);
+
+        glGenRenderbuffers(1, &depthRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width,
+                              height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                                  GL_RENDERBUFFER, depthRbo);
+
+        glViewport(0, 0, width, height);
+        return glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+               GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    void destroy() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &colorRbo);
+        glDeleteRenderbuffers(1, &depthRbo);
+        glDeleteFramebuffers(1, &fbo);
+    }
+};
+
+// the same flight every run: one slow lap around the middle of the world,
+// looking a bit down and out, bobbing up and down through the surface
+void ScriptedCameraPath(int frame, int frameCount, Camera &camera) {
+    constexpr float radius = 120.0f;
+    float t = (float)frame / (float)frameCount;
+    float angle = t * 2.0f * 3.14159265f;
+
+    camera.cameraPos = glm::vec3(radius * std::cos(angle),
+                                 10.0f + 30.0f * std::sin(angle * 3.0f),
+                                 radius * std::sin(angle));
+    camera.yaw = glm::degrees(angle) + 90.0f + 30.0f;
+    camera.pitch = -20.0f;
+
+    glm::vec3 front;
+    front.x = std::cos(glm::radians(camera.yaw)) *
+              std::cos(glm::radians(camera.pitch));
+    front.y = std::sin(glm::radians(camera.pitch));
+    front.z = std::sin(glm::radians(camera.yaw)) *
+              std::cos(glm::radians(camera.pitch));
+    camera.cameraFront = glm::normalize(front);
+    camera.cameraRight =
+        glm::normalize(glm::cross(camera.cameraFront, camera.cameraUp));
+    camera.frustum = createFrustumFromCamera(camera);
+}
+
+// per frame numbers collected in headless mode
+struct HeadlessReport {
+    std::vector<double> frameMs;
+    std::vector<std::string> stageNames;
+    std::vector<double> stageTotalMs;
+    std::vector<std::vector<double>> stageFrameMs; // per stage, per frame
+    std::vector<std::string> queueNames;
+    std::vector<std::vector<int>> queueDepths; // per queue, per frame
+    std::string cameraPath;
+    double startupMs = 0.0;    // until the chunks are created
+    double firstFrameMs = 0.0; // until the chunks around the camera are set up
+    double fullWorldMs = 0.0;  // until every chunk is
+    long long chunksDrawn = 0;
+    long long chunksCaveCulled = 0;
+    long long chunksOccluded = 0;
+    size_t peakMemory = 0;
+    // --mesh-cache lookups, see MeshCache.h
+    unsigned long long meshCacheHits = 0;
+    unsigned long long meshCacheMisses = 0;
+
+    int stage(const std::string &name) {
+        for (size_t i = 0; i < stageNames.size(); i++) {
+            if (stageNames[i] == name) {
+                return (int)i;
+            }
+        }
+        stageNames.push_back(name);
+        stageTotalMs.push_back(0.0);
+        stageFrameMs.push_back({});
+        return (int)stageNames.size() - 1;
+    }
+
+    void addStage(const std::string &name, double ms) {
+        int i = stage(name);
+        stageTotalMs[i] += ms;
+        stageFrameMs[i].push_back(ms);
+    }
+
+    void addQueueDepth(const std::string &name, int depth) {
+        size_t i = std::find(queueNames.begin(), queueNames.end(), name) -
+                   queueNames.begin();
+        if (i == queueNames.size()) {
+            queueNames.push_back(name);
+            queueDepths.push_back({});
+        }
+        queueDepths[i].push_back(depth);
+    }
+
+    bool write(const std::string &path) const;
+};
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t i = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size() - 1, i > 0 ? i - 1 : 0)];
+}
+
+bool HeadlessReport::write(const std::string &path) const {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == NULL) {
+        std::printf("headless: can't write report to %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    size_t slowFrames = 0;
+    size_t verySlowFrames = 0;
+    for (double ms : frameMs) {
+        total += ms;
+        slowFrames += ms > FrameStats::SLOW_FRAME_MS;
+        verySlowFrames += ms > FrameStats::VERY_SLOW_FRAME_MS;
+    }
+    size_t frames = frameMs.size();
+    double mean = frames > 0 ? total / frames : 0.0;
+
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"camera_path\": \"%s\",\n", cameraPath.c_str());
+    std::fprintf(file, "  \"frames\": %zu,\n", frames);
+    std::fprintf(file, "  \"startup_ms\": %.3f,\n", startupMs);
+    std::fprintf(file, "  \"time_to_first_frame_ms\": %.3f,\n", firstFrameMs);
+    std::fprintf(file, "  \"time_to_full_world_ms\": %.3f,\n", fullWorldMs);
+    std::fprintf(file, "  \"total_ms\": %.3f,\n", total);
+    std::fprintf(file, "  \"fps\": %.2f,\n", mean > 0.0 ? 1000.0 / mean : 0.0);
+    std::fprintf(file, "  \"frame_ms\": {\n");
+    std::fprintf(file, "    \"mean\": %.4f,\n", mean);
+    std::fprintf(file, "    \"min\": %.4f,\n", frames ? sorted.front() : 0.0);
+    std::fprintf(file, "    \"p50\": %.4f,\n", percentile(sorted, 0.50));
+    std::fprintf(file, "    \"p95\": %.4f,\n", percentile(sorted, 0.95));
+    std::fprintf(file, "    \"p99\": %.4f,\n", percentile(sorted, 0.99));
+    std::fprintf(file, "    \"max\": %.4f\n", frames ? sorted.back() : 0.0);
+    std::fprintf(file, "  },\n");
+    std::fprintf(file, "  \"frames_over_16_6ms\": %zu,\n", slowFrames);
+    std::fprintf(file, "  \"frames_over_33_3ms\": %zu,\n", verySlowFrames);
+    std::fprintf(file, "  \"stage_mean_ms\": {\n");
+    for (size_t i = 0; i < stageNames.size(); i++) {
+        std::fprintf(file, "    \"%s\": %.4f%s\n", stageNames[i].c_str(),
+                     frames > 0 ? stageTotalMs[i] / frames : 0.0,
+                     i + 1 < stageNames.size() ? "," : "");
+    }
+    std::fprintf(file, "  },\n");
+    std::fprintf(file, "  \"chunks_per_frame\": {\n");
+    std::fprintf(file, "    \"drawn\": %.1f,\n",
+                 frames ? (double)chunksDrawn / frames : 0.0);
+    std::fprintf(file, "    \"cave_culled\": %.1f,\n",
+                 frames ? (double)chunksCaveCulled / frames : 0.0);
+    std::fprintf(file, "    \"occluded\": %.1f\n",
+                 frames ? (double)chunksOccluded / frames : 0.0);
+    std::fprintf(file, "  },\n");
+    std::fprintf(file, "  \"queue_depth\": {\n");
+    for (size_t i = 0; i < queueNames.size(); i++) {
+        long long total = 0;
+        int max = 0;
+        for (int depth : queueDepths[i]) {
+            total += depth;
+            max = std::max(max, depth);
+        }
+        std::fprintf(file, "    \"%s\": {\"mean\": %.2f, \"max\": %d}%s\n",
+                     queueNames[i].c_str(),
+                     queueDepths[i].empty() ? 0.0
+                                            : (double)total / queueDepths[i].size(),
+                     max, i + 1 < queueNames.size() ? "," : "");
+    }
+    std::fprintf(file, "  },\n");
+    unsigned long long meshCacheLookups = meshCacheHits + meshCacheMisses;
+    std::fprintf(file,
+                 "  \"mesh_cache\": {\"hits\": %llu, \"misses\": %llu, "
+                 "\"hit_rate\": %.4f},\n",
+                 meshCacheHits, meshCacheMisses,
+                 meshCacheLookups ? (double)meshCacheHits / meshCacheLookups : 0.0);
+    std::fprintf(file, "  \"peak_memory_bytes\": %zu,\n", peakMemory);
+    // per subsystem, see MemoryStats.h
+    std::fprintf(file, "  \"memory_bytes\": {\n");
+    for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+        std::fprintf(file, "    \"%s\": {\"current\": %lld, \"peak\": %lld}%s\n",
+                     MEMORY_CATEGORY_KEYS[i],
+                     (long long)MemoryStats::bytes[i].load(),
+                     (long long)MemoryStats::peakBytes[i].load(),
+                     i + 1 < NUM_MEMORY_CATEGORIES ? "," : "");
+    }
+    std::fprintf(file, "  },\n");
+
+    // everything per frame, to diff two replays of the same path
+    std::fprintf(file, "  \"per_frame\": {\n");
+    auto writeSeries = [&](const char *name, auto &values, const char *format,
+                           bool last) {
+        std::fprintf(file, "    \"%s\": [", name);
+        for (size_t f = 0; f < values.size(); f++) {
+            if (f > 0) {
+                std::fputc(',', file);
+            }
+            std::fprintf(file, format, values[f]);
+        }
+        std::fprintf(file, "]%s\n", last ? "" : ",");
+    };
+    writeSeries("frame_ms", frameMs, "%.3f",
+                stageNames.empty() && queueNames.empty());
+    for (size_t i = 0; i < stageNames.size(); i++) {
+        writeSeries(stageNames[i].c_str(), stageFrameMs[i], "%.3f",
+                    i + 1 == stageNames.size() && queueNames.empty());
+    }
+    for (size_t i = 0; i < queueNames.size(); i++) {
+        std::string name = "queue." + queueNames[i];
+        writeSeries(name.c_str(), queueDepths[i], "%d",
+                    i + 1 == queueNames.size());
+    }
+    std::fprintf(file, "  }\n");
+    std::fprintf(file, "}\n");
+    std::fclose(file);
+    return true;
+}
+
+#endif // HEADLESS_H
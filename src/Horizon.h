@@ -0,0 +1,308 @@
+#ifndef HORIZON_H
+#define HORIZON_H
+
+#include "Block.h"
+#include "Camera.h"
+#include "MemoryStats.h"
+#include "Profiler.h"
+#include "TerrainGenerator.h"
+#include "smolgl.h"
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <learnopengl/shader_m.h>
+#include <vector>
+
+/*
+    Far terrain past the chunk render distance.
+
+    The surface is sampled straight from the terrain generator
+    (TerrainGenerator::sampleSurface) in NUM_RINGS square rings around the
+    camera, a clipmap. Every ring has GRID x GRID samples and twice the
+    spacing of the ring inside it.
+
+    The samples of a ring live in a GRID x GRID slot grid that wraps around,
+    sample (ix, iz) always goes in slot (ix % GRID, iz % GRID). When the
+    camera moves only the rows/columns that scrolled in get sampled again,
+    everything else stays where it is.
+    All rings share one vertex buffer and one static index buffer over the
+    slots, the wrap-around seam is skipped when drawing.
+
+    Fragments inside the chunk render distance and inside the next ring in
+    are discarded, and the horizon is drawn first with its own far plane,
+    then the depth buffer is cleared for the chunks.
+*/
+
+struct HorizonVertex {
+    float x, y, z;
+    unsigned int color; // rgba8
+};
+
+struct Horizon {
+    static constexpr int NUM_RINGS = 6;
+    static constexpr int GRID = 64;        // samples per ring side
+    static constexpr int BASE_SPACING = 4; // blocks between ring 0 samples
+    static constexpr float NEAR_PLANE = 1.0f;
+    static constexpr float FAR_PLANE = 40000.0f;
+
+    struct Ring {
+        int spacing;          // blocks between samples
+        int originX, originZ; // first sample index on each axis
+        bool valid = false;   // sampled at least once
+        bool dirty = false;   // vertices changed since the last upload
+        std::vector<int> slotX, slotZ; // sample index held by each slot
+    };
+
+    TerrainGenerator *generator;
+    Shader *shader;
+    Ring rings[NUM_RINGS];
+    std::vector<HorizonVertex> vertices; // ring, then slot row, then column
+    unsigned int vaoId = 0;
+    unsigned int vboId = 0;
+    unsigned int eboId = 0;
+    bool enabled = true;
+    int samplesLastUpdate = 0;
+    size_t cacheBytes = 0; // samples kept on the CPU, see MemoryStats.h
+
+    Horizon(TerrainGenerator *generator, Shader *shader);
+    ~Horizon();
+    void update(glm::vec3 cameraPos);
+    void render(Camera camera, float innerRadius);
+
+  private:
+    bool hasSurface;
+    void sample(int ring, int ix, int iz);
+};
+
+static unsigned int horizonColor(BlockType type) {
+    unsigned int r, g, b;
+    switch (type) {
+    case BlockType::Sand:
+        r = 219, g = 207, b = 163;
+        break;
+    case BlockType::Dirt:
+        r = 134, g = 96, b = 67;
+        break;
+    case BlockType::Water:
+        r = 47, g = 80, b = 170;
+        break;
+    case BlockType::Stone:
+        r = 125, g = 125, b = 125;
+        break;
+    case BlockType::Wood:
+        r = 102, g = 81, b = 51;
+        break;
+    case BlockType::Leaves:
+        r = 40, g = 100, b = 25;
+        break;
+    default:
+        r = 95, g = 159, b = 53;
+        break;
+    }
+    return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+Horizon::Horizon(TerrainGenerator *_generator, Shader *_shader) {
+    generator = _generator;
+    shader = _shader;
+
+    float height;
+    BlockType type;
+    hasSurface = generator->sampleSurface(0.0f, 0.0f, height, type);
+
+    vertices.resize(NUM_RINGS * GRID * GRID);
+    for (int r = 0; r < NUM_RINGS; r++) {
+        rings[r].spacing = BASE_SPACING << r;
+        rings[r].slotX.assign(GRID * GRID, INT_MIN);
+        rings[r].slotZ.assign(GRID * GRID, INT_MIN);
+    }
+    // the slot grids are a cache of generator output
+    cacheBytes = vertices.size() * sizeof(HorizonVertex) +
+                 NUM_RINGS * GRID * GRID * 2 * sizeof(int);
+    MemoryStats::add(MEM_GENERATOR_CACHE, cacheBytes);
+
+    // two triangles between every slot and its +x/+z neighbours, wrapping
+    // around, so the index buffer never changes
+    std::vector<unsigned int> indices;
+    indices.reserve(NUM_RINGS * GRID * GRID * 6);
+    for (int r = 0; r < NUM_RINGS; r++) {
+        unsigned int base = r * GRID * GRID;
+        for (int z = 0; z < GRID; z++) {
+            for (int x = 0; x < GRID; x++) {
+                unsigned int i00 = base + z * GRID + x;
+                unsigned int i10 = base + z * GRID + (x + 1) % GRID;
+                unsigned int i01 = base + ((z + 1) % GRID) * GRID + x;
+                unsigned int i11 = base + ((z + 1) % GRID) * GRID + (x + 1) % GRID;
+                indices.insert(indices.end(), {i00, i01, i10, i10, i01, i11});
+            }
+        }
+    }
+
+    glGenVertexArrays(1, &vaoId);
+    glBindVertexArray(vaoId);
+    vboId = smolLoadVertexBuffer(vertices.data(),
+                                 vertices.size() * sizeof(HorizonVertex), true);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(HorizonVertex),
+                          (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                          sizeof(HorizonVertex),
+                          (void *)offsetof(HorizonVertex, color));
+    glEnableVertexAttribArray(1);
+    eboId = smolLoadVertexBufferElement(
+        indices.data(), indices.size() * sizeof(unsigned int), false);
+    glBindVertexArray(0);
+}
+
+Horizon::~Horizon() {
+    smolUnloadBuffer(vboId);
+    smolUnloadBuffer(eboId);
+    glDeleteVertexArrays(1, &vaoId);
+    MemoryStats::remove(MEM_GENERATOR_CACHE, cacheBytes);
+}
+
+void Horizon::sample(int r, int ix, int iz) {
+    Ring &ring = rings[r];
+    int slot = (((iz % GRID) + GRID) % GRID) * GRID + ((ix % GRID) + GRID) % GRID;
+    if (ring.slotX[slot] == ix && ring.slotZ[slot] == iz) {
+        return;
+    }
+    ring.slotX[slot] = ix;
+    ring.slotZ[slot] = iz;
+
+    float x = (float)ix * ring.spacing;
+    float z = (float)iz * ring.spacing;
+    float height = 0.0f;
+    BlockType type = BlockType::Grass;
+    generator->sampleSurface(x, z, height, type);
+
+    // top of the block, blocks are centred on their coordinate
+    HorizonVertex &v = vertices[r * GRID * GRID + slot];
+    v.x = x * Block::BLOCK_RENDER_SIZE;
+    v.y = (height + 0.5f) * Block::BLOCK_RENDER_SIZE;
+    v.z = z * Block::BLOCK_RENDER_SIZE;
+    v.color = horizonColor(type);
+    ring.dirty = true;
+    samplesLastUpdate++;
+}
+
+// re-centre every ring on the camera, only sampling slots whose sample
+// changed
+void Horizon::update(glm::vec3 cameraPos) {
+    PROFILE_SCOPE("horizon update");
+    samplesLastUpdate = 0;
+    if (!enabled || !hasSurface) {
+        return;
+    }
+
+    glm::vec3 cameraBlock = cameraPos / (float)Block::BLOCK_RENDER_SIZE;
+    for (int r = 0; r < NUM_RINGS; r++) {
+        Ring &ring = rings[r];
+        int originX = (int)std::floor(cameraBlock.x / ring.spacing) - GRID / 2;
+        int originZ = (int)std::floor(cameraBlock.z / ring.spacing) - GRID / 2;
+        if (ring.valid && originX == ring.originX && originZ == ring.originZ) {
+            continue;
+        }
+        ring.originX = originX;
+        ring.originZ = originZ;
+        ring.valid = true;
+        for (int iz = originZ; iz < originZ + GRID; iz++) {
+            for (int ix = originX; ix < originX + GRID; ix++) {
+                sample(r, ix, iz);
+            }
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, vboId);
+    for (int r = 0; r < NUM_RINGS; r++) {
+        if (!rings[r].dirty) {
+            continue;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        r * GRID * GRID * sizeof(HorizonVertex),
+                        GRID * GRID * sizeof(HorizonVertex),
+                        vertices.data() + r * GRID * GRID);
+        rings[r].dirty = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// innerRadius: world distance covered by chunks, nothing is drawn inside it
+void Horizon::render(Camera camera, float innerRadius) {
+    PROFILE_SCOPE("horizon render");
+    if (!enabled || !hasSurface) {
+        return;
+    }
+
+    shader->use();
+    glm::mat4 projection =
+        glm::perspective(glm::radians(camera.fov), (float)SCR_WIDTH / SCR_HEIGHT,
+                         NEAR_PLANE, FAR_PLANE);
+    glm::mat4 view = glm::lookAt(camera.cameraPos,
+                                 camera.cameraPos + camera.cameraFront,
+                                 camera.cameraUp);
+    shader->setMat4("projection", projection);
+    shader->setMat4("view", view);
+    shader->setVec3("cameraPos", camera.cameraPos);
+    shader->setFloat("innerRadius", innerRadius);
+    shader->setFloat("fogEnd", GRID / 2 * rings[NUM_RINGS - 1].spacing *
+                                   Block::BLOCK_RENDER_SIZE);
+
+    glBindVertexArray(vaoId);
+    std::vector<GLsizei> counts;
+    std::vector<const void *> offsets;
+    for (int r = 0; r < NUM_RINGS; r++) {
+        const Ring &ring = rings[r];
+        float worldSpacing = ring.spacing * Block::BLOCK_RENDER_SIZE;
+        if (!ring.valid || GRID / 2 * worldSpacing < innerRadius) {
+            continue; // all of it is under the chunks
+        }
+
+        // the ring inside this one covers this area, minus a sample so
+        // there's no gap where they meet
+        glm::vec4 innerRect = glm::vec4(1.0f, 1.0f, -1.0f, -1.0f);
+        if (r > 0 && rings[r - 1].valid) {
+            const Ring &inner = rings[r - 1];
+            float innerSpacing = inner.spacing * Block::BLOCK_RENDER_SIZE;
+            innerRect = glm::vec4((inner.originX + 1) * innerSpacing,
+                                  (inner.originZ + 1) * innerSpacing,
+                                  (inner.originX + GRID - 2) * innerSpacing,
+                                  (inner.originZ + GRID - 2) * innerSpacing);
+        }
+        shader->setVec4("innerRect", innerRect);
+
+        // the slots of the last row/column are next to the first ones in
+        // the buffer but on the other side of the ring, skip those quads
+        int seamX = (((ring.originX - 1) % GRID) + GRID) % GRID;
+        int seamZ = (((ring.originZ - 1) % GRID) + GRID) % GRID;
+        size_t base = (size_t)r * GRID * GRID * 6;
+        counts.clear();
+        offsets.clear();
+        for (int z = 0; z < GRID; z++) {
+            if (z == seamZ) {
+                continue;
+            }
+            size_t row = base + (size_t)z * GRID * 6;
+            if (seamX > 0) {
+                counts.push_back(seamX * 6);
+                offsets.push_back((void *)(row * sizeof(unsigned int)));
+            }
+            if (seamX < GRID - 1) {
+                counts.push_back((GRID - 1 - seamX) * 6);
+                offsets.push_back(
+                    (void *)((row + (seamX + 1) * 6) * sizeof(unsigned int)));
+            }
+        }
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT,
+                            offsets.data(), (GLsizei)counts.size());
+    }
+    glBindVertexArray(0);
+
+    // the chunks are always nearer than the horizon, and use a different
+    // depth range
+    glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+#endif // HORIZON_H
@@ -0,0 +1,181 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <cstdint>
+#include <cstring>
+
+/*
+    LZ4 block format, compressor and decompressor. Output is a plain LZ4
+    block (no frame header), any LZ4 implementation can read it, but it's
+    small enough to keep here rather than pull in the library.
+
+        int size = Lz4Compress(src, srcSize, dst, Lz4CompressBound(srcSize));
+        int back = Lz4Decompress(dst, size, out, srcSize);
+
+    A block is a list of sequences: a token (literal count << 4 | match
+    length - 4, 15 meaning more length bytes follow), the literals, a 2 byte
+    offset back into the output and the match. The last sequence is
+    literals only, and the last 5 bytes are always literals.
+
+    The compressor is the greedy single-probe one: a 4096 entry hash table
+    of the last position each 4 byte string was seen at. Fast rather than
+    small, the region files (WorldStorage.h) use it on top of palette + RLE.
+*/
+
+constexpr int LZ4_MIN_MATCH = 4;
+constexpr int LZ4_LAST_LITERALS = 5;
+constexpr int LZ4_MATCH_LIMIT = 12; // no match starts in the last 12 bytes
+constexpr int LZ4_HASH_LOG = 12;
+constexpr int LZ4_MAX_OFFSET = 65535;
+
+inline int Lz4CompressBound(int size) { return size + size / 255 + 16; }
+
+static inline uint32_t lz4Read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lz4Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// 15 in the token, then 255s and the rest
+static inline uint8_t *lz4WriteLength(uint8_t *op, int length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// bytes written to dst, 0 if they don't fit in dstCapacity
+int Lz4Compress(const uint8_t *src, int srcSize, uint8_t *dst, int dstCapacity) {
+    int table[1 << LZ4_HASH_LOG];
+    for (int &entry : table) {
+        entry = -1;
+    }
+    uint8_t *op = dst;
+    const uint8_t *dstEnd = dst + dstCapacity;
+
+    // a sequence of literals [anchor, literalEnd), then a match of matchLength
+    // at offset, or no match (matchLength 0) for the last one
+    auto emit = [&](int anchor, int literalEnd, int offset, int matchLength) {
+        int literals = literalEnd - anchor;
+        // token, length bytes, literals, offset, match length bytes
+        if (dstEnd - op < 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1) {
+            return false;
+        }
+        uint8_t *token = op++;
+        *token = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15) {
+            op = lz4WriteLength(op, literals);
+        }
+        if (literals > 0) {
+            std::memcpy(op, src + anchor, literals);
+        }
+        op += literals;
+        if (matchLength == 0) {
+            return true;
+        }
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        int length = matchLength - LZ4_MIN_MATCH;
+        *token |= (uint8_t)(length >= 15 ? 15 : length);
+        if (length >= 15) {
+            op = lz4WriteLength(op, length);
+        }
+        return true;
+    };
+
+    int ip = 0, anchor = 0;
+    int matchStartLimit = srcSize - LZ4_MATCH_LIMIT;
+    int matchEndLimit = srcSize - LZ4_LAST_LITERALS;
+    while (ip < matchStartLimit) {
+        uint32_t sequence = lz4Read32(src + ip);
+        uint32_t hash = lz4Hash(sequence);
+        int ref = table[hash];
+        table[hash] = ip;
+        if (ref < 0 || ip - ref > LZ4_MAX_OFFSET || lz4Read32(src + ref) != sequence) {
+            ip++;
+            continue;
+        }
+        int length = LZ4_MIN_MATCH;
+        while (ip + length < matchEndLimit && src[ref + length] == src[ip + length]) {
+            length++;
+        }
+        if (!emit(anchor, ip, ip - ref, length)) {
+            return 0;
+        }
+        ip += length;
+        anchor = ip;
+        // runs are the common case here, keep the position before the
+        // next one in the table too
+        if (ip - 2 >= 0 && ip - 2 < matchStartLimit) {
+            table[lz4Hash(lz4Read32(src + ip - 2))] = ip - 2;
+        }
+    }
+    if (!emit(anchor, srcSize, 0, 0)) {
+        return 0;
+    }
+    return (int)(op - dst);
+}
+
+// bytes written to dst, -1 if src isn't a valid block or doesn't fit
+int Lz4Decompress(const uint8_t *src, int srcSize, uint8_t *dst, int dstCapacity) {
+    const uint8_t *ip = src, *srcEnd = src + srcSize;
+    uint8_t *op = dst, *dstEnd = dst + dstCapacity;
+    auto readLength = [&](int length) {
+        if (length != 15) {
+            return length;
+        }
+        uint8_t byte;
+        do {
+            if (ip >= srcEnd) {
+                return -1;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return length;
+    };
+
+    while (ip < srcEnd) {
+        uint8_t token = *ip++;
+        int literals = readLength(token >> 4);
+        if (literals < 0 || srcEnd - ip < literals || dstEnd - op < literals) {
+            return -1;
+        }
+        if (literals > 0) {
+            std::memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == srcEnd) {
+            break; // the last sequence has no match
+        }
+
+        if (srcEnd - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        int length = readLength(token & 15);
+        if (length < 0 || offset == 0 || offset > op - dst) {
+            return -1;
+        }
+        length += LZ4_MIN_MATCH;
+        if (dstEnd - op < length) {
+            return -1;
+        }
+        // byte by byte, the match may overlap what it writes (runs)
+        const uint8_t *match = op - offset;
+        for (int i = 0; i < length; i++) {
+            op[i] = match[i];
+        }
+        op += length;
+    }
+    return (int)(op - dst);
+}
+
+#endif // LZ4_H
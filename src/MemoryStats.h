@@ -0,0 +1,96 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+    Bytes held by each subsystem, counted where they are allocated and
+    freed instead of guessed from the process RSS:
+
+        MemoryStats::add(MEM_MESH_CPU, bytes);    // after malloc
+        MemoryStats::remove(MEM_MESH_CPU, bytes); // before free
+
+    resize is for a buffer that grows or shrinks while it stays one
+    allocation (a vector), only its bytes change.
+
+    The counters are atomics, generation and meshing run on worker threads.
+    GPU buffers are what was passed to glBufferData, the driver may keep a
+    shadow copy or round up, so it's a lower bound on VRAM.
+*/
+
+enum MemoryCategory {
+    MEM_CHUNK_BLOCKS,    // Chunk::blocks
+    MEM_MESH_CPU,        // ChunkMesh vertex / index arrays
+    MEM_GPU_BUFFERS,     // smolLoadVertexBuffer*
+    MEM_ECS,             // ComponentArray storage
+    MEM_GENERATOR_CACHE, // cached terrain generator output
+    MEM_IO_QUEUE,        // chunks waiting to be written, see ChunkIO.h
+    NUM_MEMORY_CATEGORIES
+};
+
+static const char *const MEMORY_CATEGORY_NAMES[NUM_MEMORY_CATEGORIES] = {
+    "chunk blocks", "mesh (cpu)", "gpu buffers", "ecs components",
+    "generator caches", "io queue"};
+
+// snake_case versions for the benchmark reports
+static const char *const MEMORY_CATEGORY_KEYS[NUM_MEMORY_CATEGORIES] = {
+    "chunk_blocks", "mesh_cpu", "gpu_buffers", "ecs_components",
+    "generator_caches", "io_queue"};
+
+struct MemoryStats {
+    static std::atomic<int64_t> bytes[NUM_MEMORY_CATEGORIES];
+    static std::atomic<int64_t> peakBytes[NUM_MEMORY_CATEGORIES];
+    static std::atomic<int64_t> allocations[NUM_MEMORY_CATEGORIES]; // live
+
+    static void add(MemoryCategory category, size_t size);
+    static void remove(MemoryCategory category, size_t size);
+    static void resize(MemoryCategory category, size_t oldSize, size_t newSize);
+    static int64_t total();
+
+  private:
+    static void updatePeak(MemoryCategory category, int64_t now);
+};
+
+std::atomic<int64_t> MemoryStats::bytes[NUM_MEMORY_CATEGORIES] = {};
+std::atomic<int64_t> MemoryStats::peakBytes[NUM_MEMORY_CATEGORIES] = {};
+std::atomic<int64_t> MemoryStats::allocations[NUM_MEMORY_CATEGORIES] = {};
+
+void MemoryStats::add(MemoryCategory category, size_t size) {
+    int64_t now = bytes[category].fetch_add((int64_t)size,
+                                            std::memory_order_relaxed) +
+                  (int64_t)size;
+    allocations[category].fetch_add(1, std::memory_order_relaxed);
+    updatePeak(category, now);
+}
+
+void MemoryStats::resize(MemoryCategory category, size_t oldSize,
+                         size_t newSize) {
+    int64_t delta = (int64_t)newSize - (int64_t)oldSize;
+    int64_t now =
+        bytes[category].fetch_add(delta, std::memory_order_relaxed) + delta;
+    updatePeak(category, now);
+}
+
+void MemoryStats::updatePeak(MemoryCategory category, int64_t now) {
+    int64_t peak = peakBytes[category].load(std::memory_order_relaxed);
+    while (now > peak && !peakBytes[category].compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+}
+
+void MemoryStats::remove(MemoryCategory category, size_t size) {
+    bytes[category].fetch_sub((int64_t)size, std::memory_order_relaxed);
+    allocations[category].fetch_sub(1, std::memory_order_relaxed);
+}
+
+int64_t MemoryStats::total() {
+    int64_t sum = 0;
+    for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+        sum += bytes[i].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+#endif // MEMORYSTATS_H
@@ -0,0 +1,465 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "ChunkMesh.h"
+#include "Hash.h"
+#include "MemoryStats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    Finished chunk meshes on disk, keyed by a hash of everything the mesher
+    reads (Chunk::meshKey), so chunks that are the same as last session are
+    uploaded without meshing them again:
+
+        MeshCache cache("meshes.vxmc", 256 << 20);
+        if (!cache.get(key, opaque, translucent, connectivity, layers)) {
+            ... mesh ...
+            cache.put(key, opaque, translucent, connectivity, layers);
+        }
+
+    The file is a fixed size ring of records, mapped into memory:
+
+        header (MeshCacheHeader), records (MeshCacheRecord + payload) ...
+
+    New records go at head. When the end is reached writing wraps around to
+    the start, dropping the oldest records (from tail) to make room. A hit
+    on a record in the oldest quarter copies it to head again, so the ring
+    is FIFO with reinsertion: close to LRU, without writing to the file on
+    every hit.
+
+    A record's payload is the vertices of both meshes, then a bit per quad
+    for the diagonal it was split along (see Chunk::AddCubeFace). The
+    indices are made again from those on a hit, which keeps a record at 16
+    bytes a face instead of 40.
+
+    Only the index (key -> record offset) is kept in memory, built by
+    walking the ring when the file is opened. A file that doesn't walk
+    cleanly (a different version, size, or a torn write) starts over
+    empty. Bump MESH_CACHE_VERSION when the mesher's output changes.
+
+    On Windows the file is read into memory when opened and written back
+    when closed instead of mapped.
+*/
+
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+constexpr uint32_t MESH_CACHE_RECORD_MAGIC = 0x4D435852; // "RXCM"
+
+struct MeshCacheHeader {
+    char magic[4]; // "VXMC"
+    uint32_t version;
+    uint64_t capacity; // file size
+    // records are in [tail, head), or [tail, lapEnd) then [start, head)
+    // once writing has wrapped around
+    uint64_t head;
+    uint64_t tail;
+    uint64_t lapEnd;
+    uint32_t wrapped;
+    uint32_t reserved;
+};
+
+struct MeshCacheRecord {
+    uint32_t magic;
+    uint32_t size; // header and payload, a multiple of 8
+    uint64_t key;
+    uint64_t checksum; // Hash64 of the payload
+    uint64_t faceConnectivity;
+    int32_t solidLayers;
+    int32_t vertexCount[2]; // opaque, translucent
+    int32_t reserved;
+};
+
+class MeshCache {
+  public:
+    static constexpr uint64_t DATA_START = sizeof(MeshCacheHeader);
+    static constexpr uint64_t MIN_CAPACITY = 1 << 20;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> evictions{0};
+    std::atomic<uint64_t> reinserts{0};
+
+    MeshCache(const std::string &path, uint64_t capacity) : path(path) {
+        capacity = capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity & ~7ull;
+        open(capacity);
+    }
+
+    ~MeshCache() { close(); }
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    bool isOpen() const { return base != nullptr; }
+
+    // fills the two meshes (CPU side, malloc'd like Chunk::buildMesh does)
+    // and the visibility data saved with them, false if key isn't cached
+    bool get(uint64_t key, ChunkMesh &opaque, ChunkMesh &translucent,
+             uint64_t &faceConnectivity, int &solidLayers) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            misses++;
+            return false;
+        }
+        uint64_t offset = it->second;
+        const MeshCacheRecord &record = recordAt(offset);
+        const uint8_t *payload = base + offset + sizeof(MeshCacheRecord);
+        const uint8_t *flips = payload +
+            ((size_t)record.vertexCount[0] + record.vertexCount[1]) * sizeof(int);
+        unpackMesh(opaque, (const int *)payload, record.vertexCount[0], flips);
+        unpackMesh(translucent, (const int *)payload + record.vertexCount[0],
+                   record.vertexCount[1], flips + flipBytes(record.vertexCount[0]));
+        faceConnectivity = record.faceConnectivity;
+        solidLayers = record.solidLayers;
+        hits++;
+
+        // about to be dropped, move it back to the front of the ring
+        if (ringPosition(offset) < usedBytes() / 4) {
+            std::vector<uint8_t> copy(base + offset, base + offset + record.size);
+            index.erase(it);
+            if (append(copy.data(), copy.size(), key)) {
+                reinserts++;
+            }
+        }
+        return true;
+    }
+
+    void put(uint64_t key, const ChunkMesh &opaque, const ChunkMesh &translucent,
+             uint64_t faceConnectivity, int solidLayers) {
+        if (!isOpen()) {
+            return;
+        }
+        MeshCacheRecord record = {};
+        record.magic = MESH_CACHE_RECORD_MAGIC;
+        record.key = key;
+        record.faceConnectivity = faceConnectivity;
+        record.solidLayers = solidLayers;
+        record.vertexCount[0] = opaque.vertexCount;
+        record.vertexCount[1] = translucent.vertexCount;
+        size_t payloadSize =
+            ((size_t)opaque.vertexCount + translucent.vertexCount) * sizeof(int) +
+            flipBytes(opaque.vertexCount) + flipBytes(translucent.vertexCount);
+        record.size = (uint32_t)((sizeof(MeshCacheRecord) + payloadSize + 7) & ~(size_t)7);
+
+        // built outside the lock, meshing threads only wait for the copy
+        std::vector<uint8_t> bytes(record.size, 0);
+        uint8_t *payload = bytes.data() + sizeof(MeshCacheRecord);
+        uint8_t *flips = payload;
+        if (opaque.vertexCount > 0) {
+            std::memcpy(flips, opaque.vertices, opaque.vertexCount * sizeof(int));
+            flips += opaque.vertexCount * sizeof(int);
+        }
+        if (translucent.vertexCount > 0) {
+            std::memcpy(flips, translucent.vertices, translucent.vertexCount * sizeof(int));
+            flips += translucent.vertexCount * sizeof(int);
+        }
+        packFlips(opaque, flips);
+        packFlips(translucent, flips + flipBytes(opaque.vertexCount));
+        record.checksum = Hash64(payload, payloadSize);
+        std::memcpy(bytes.data(), &record, sizeof(record));
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (index.count(key) != 0) {
+            return; // same key, same mesh
+        }
+        if (append(bytes.data(), bytes.size(), key)) {
+            stores++;
+        }
+    }
+
+    double hitRate() const {
+        uint64_t lookups = hits.load() + misses.load();
+        return lookups > 0 ? (double)hits.load() / lookups : 0.0;
+    }
+
+    size_t entries() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return index.size();
+    }
+
+    uint64_t bytesUsed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return isOpen() ? usedBytes() : 0;
+    }
+
+    uint64_t capacity() const { return isOpen() ? header->capacity : 0; }
+
+    const std::string &getPath() const { return path; }
+
+  private:
+    std::string path;
+    uint8_t *base = nullptr; // the whole file
+    MeshCacheHeader *header = nullptr;
+    std::unordered_map<uint64_t, uint64_t> index; // key -> record offset
+    std::mutex mutex;
+#ifndef _WIN32
+    int fd = -1;
+#endif
+
+    static size_t flipBytes(int vertexCount) { return (vertexCount / 4 + 7) / 8; }
+
+    const MeshCacheRecord &recordAt(uint64_t offset) const {
+        return *(const MeshCacheRecord *)(base + offset);
+    }
+
+    // bytes held by records, in ring order
+    uint64_t usedBytes() const {
+        if (header->wrapped) {
+            return (header->lapEnd - header->tail) + (header->head - DATA_START);
+        }
+        return header->head - header->tail;
+    }
+
+    // bytes of records older than the one at offset
+    uint64_t ringPosition(uint64_t offset) const {
+        if (offset >= header->tail) {
+            return offset - header->tail;
+        }
+        return (header->lapEnd - header->tail) + (offset - DATA_START);
+    }
+
+    // the flip bit of each quad, from its first index (v2 when flipped)
+    static void packFlips(const ChunkMesh &mesh, uint8_t *out) {
+        int quads = mesh.vertexCount / 4;
+        for (int q = 0; q < quads; q++) {
+            if (mesh.indices[q * 6] != (unsigned int)(q * 4)) {
+                out[q >> 3] |= (uint8_t)(1 << (q & 7));
+            }
+        }
+    }
+
+    // same layout as AddCubeFace writes
+    static void unpackMesh(ChunkMesh &mesh, const int *vertices, int vertexCount,
+                           const uint8_t *flips) {
+        mesh = {0};
+        if (vertexCount == 0) {
+            return;
+        }
+        int quads = vertexCount / 4;
+        mesh.vertexCount = vertexCount;
+        mesh.triangleCount = quads * 2;
+        mesh.vertices = (int *)malloc(vertexCount * sizeof(int));
+        mesh.indices = (unsigned int *)malloc(quads * 6 * sizeof(unsigned int));
+        mesh.cpuBytes = vertexCount * sizeof(int) + quads * 6 * sizeof(unsigned int);
+        MemoryStats::add(MEM_MESH_CPU, mesh.cpuBytes);
+        std::memcpy(mesh.vertices, vertices, vertexCount * sizeof(int));
+        for (int q = 0; q < quads; q++) {
+            unsigned int v = q * 4;
+            unsigned int *i = mesh.indices + q * 6;
+            if (flips[q >> 3] & (1 << (q & 7))) {
+                i[0] = v + 1; i[1] = v + 2; i[2] = v + 3;
+                i[3] = v + 1; i[4] = v + 3; i[5] = v;
+            } else {
+                i[0] = v; i[1] = v + 1; i[2] = v + 2;
+                i[3] = v; i[4] = v + 2; i[5] = v + 3;
+            }
+        }
+    }
+
+    // drops the oldest record
+    void evictTail() {
+        const MeshCacheRecord &record = recordAt(header->tail);
+        auto it = index.find(record.key);
+        if (it != index.end() && it->second == header->tail) {
+            index.erase(it);
+            evictions++;
+        }
+        header->tail += record.size;
+        if (header->tail >= header->lapEnd) {
+            // the old lap is gone, the oldest records are the new lap's
+            header->tail = DATA_START;
+            header->wrapped = 0;
+        }
+    }
+
+    // writes a record at head, dropping old ones until it fits
+    bool append(const uint8_t *bytes, size_t size, uint64_t key) {
+        if (!isOpen() || size > header->capacity - DATA_START) {
+            return false;
+        }
+        while (true) {
+            if (!header->wrapped) {
+                if (header->head + size <= header->capacity) {
+                    break;
+                }
+                header->lapEnd = header->head;
+                header->head = DATA_START;
+                header->wrapped = 1;
+            }
+            if (header->tail >= header->lapEnd) {
+                // nothing left of the old lap
+                header->tail = DATA_START;
+                header->wrapped = 0;
+                continue;
+            }
+            // wrapped, the free space is [head, tail)
+            if (header->head + size <= header->tail) {
+                break;
+            }
+            evictTail();
+        }
+        // the record is written before head moves past it, a torn write is
+        // at worst a record the walk rejects
+        std::memcpy(base + header->head, bytes, size);
+        index[key] = header->head;
+        header->head += size;
+        return true;
+    }
+
+    void reset() {
+        std::memset(header, 0, sizeof(MeshCacheHeader));
+        std::memcpy(header->magic, "VXMC", 4);
+        header->version = MESH_CACHE_VERSION;
+        header->capacity = mappedSize();
+        header->head = header->tail = header->lapEnd = DATA_START;
+        index.clear();
+    }
+
+    // indexes [from, to), false at anything that isn't a whole record
+    bool walk(uint64_t from, uint64_t to) {
+        while (from < to) {
+            if (to - from < sizeof(MeshCacheRecord)) {
+                return false;
+            }
+            const MeshCacheRecord &record = recordAt(from);
+            uint64_t vertices = (uint64_t)(uint32_t)record.vertexCount[0] +
+                                (uint32_t)record.vertexCount[1];
+            if (record.magic != MESH_CACHE_RECORD_MAGIC || record.size % 8 != 0 ||
+                record.size < sizeof(MeshCacheRecord) || record.size > to - from ||
+                record.vertexCount[0] < 0 || record.vertexCount[1] < 0 ||
+                record.vertexCount[0] % 4 != 0 || record.vertexCount[1] % 4 != 0) {
+                return false;
+            }
+            size_t payloadSize = vertices * sizeof(int) +
+                                 flipBytes(record.vertexCount[0]) +
+                                 flipBytes(record.vertexCount[1]);
+            if (sizeof(MeshCacheRecord) + payloadSize > record.size ||
+                Hash64(base + from + sizeof(MeshCacheRecord), payloadSize) !=
+                    record.checksum) {
+                return false;
+            }
+            index[record.key] = from;
+            from += record.size;
+        }
+        return true;
+    }
+
+    bool validHeader() const {
+        const MeshCacheHeader &h = *header;
+        if (std::memcmp(h.magic, "VXMC", 4) != 0 || h.version != MESH_CACHE_VERSION ||
+            h.capacity != mappedSize()) {
+            return false;
+        }
+        auto inside = [&](uint64_t offset) {
+            return offset >= DATA_START && offset <= h.capacity;
+        };
+        if (!inside(h.head) || !inside(h.tail) || !inside(h.lapEnd)) {
+            return false;
+        }
+        return h.wrapped ? h.head <= h.tail && h.tail < h.lapEnd : h.tail <= h.head;
+    }
+
+    void load() {
+        bool ok = validHeader();
+        // oldest first, so a reinserted record's newer copy wins
+        if (ok && header->wrapped) {
+            ok = walk(header->tail, header->lapEnd) && walk(DATA_START, header->head);
+        } else if (ok) {
+            ok = walk(header->tail, header->head);
+        }
+        if (!ok) {
+            reset();
+        }
+    }
+
+#ifndef _WIN32
+    uint64_t fileSize = 0;
+    uint64_t mappedSize() const { return fileSize; }
+
+    void open(uint64_t capacity) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::fprintf(stderr, "mesh cache: can't open %s\n", path.c_str());
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 ||
+            ((uint64_t)st.st_size != capacity && ftruncate(fd, (off_t)capacity) != 0)) {
+            std::fprintf(stderr, "mesh cache: can't size %s\n", path.c_str());
+            ::close(fd);
+            fd = -1;
+            return;
+        }
+        void *mapped = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            std::fprintf(stderr, "mesh cache: can't map %s\n", path.c_str());
+            ::close(fd);
+            fd = -1;
+            return;
+        }
+        fileSize = capacity;
+        base = (uint8_t *)mapped;
+        header = (MeshCacheHeader *)base;
+        load();
+    }
+
+    void close() {
+        if (base != nullptr) {
+            munmap(base, fileSize);
+            base = nullptr;
+            header = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+#else
+    std::vector<uint8_t> memory;
+    uint64_t mappedSize() const { return memory.size(); }
+
+    void open(uint64_t capacity) {
+        memory.assign(capacity, 0);
+        FILE *file = std::fopen(path.c_str(), "rb");
+        if (file != nullptr) {
+            size_t read = std::fread(memory.data(), 1, memory.size(), file);
+            (void)read; // short or missing files fail the header check
+            std::fclose(file);
+        }
+        base = memory.data();
+        header = (MeshCacheHeader *)base;
+        load();
+    }
+
+    void close() {
+        if (base == nullptr) {
+            return;
+        }
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (file != nullptr) {
+            std::fwrite(memory.data(), 1, memory.size(), file);
+            std::fclose(file);
+        }
+        base = nullptr;
+        header = nullptr;
+        memory.clear();
+    }
+#endif
+};
+
+#endif // MESH_CACHE_H
@@ -0,0 +1,387 @@
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include "Block.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2
+#endif
+
+/*
+    Software occlusion culling for the surface, where hills hide the
+    valleys behind them.
+
+    Every frame a few big boxes (the solid bottom of the nearest chunks) are
+    rasterized into a small CPU depth buffer, then every chunk that passed
+    the frustum test checks its bounding box against a min pyramid (hi-z)
+    of that buffer.
+
+    The buffer holds 1/w (reciprocal view depth) because that is linear in
+    screen space. Bigger is nearer and 0 means no occluder.
+    Rows are split in bands that are rasterized on separate threads, each
+    band rasterizes every triangle clipped to its rows, so there's nothing
+    to lock. The band threads are started on the first render and then
+    just woken every frame, the calling thread does the first band. The inner loop does 4 pixels at a time with SSE2 where we have
+    it.
+
+    Nothing here touches OpenGL.
+*/
+
+struct OcclusionBox {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// full layers of opaque blocks from the bottom of a size^3 block array,
+// that part of the chunk is solid all the way through and can occlude
+inline int SolidLayersFromBottom(const Block *blocks, int size) {
+    for (int y = 0; y < size; y++) {
+        for (int z = 0; z < size; z++) {
+            for (int x = 0; x < size; x++) {
+                const Block &block = blocks[x + y * size + z * size * size];
+                if (!block.isActive || block.isTranslucent()) {
+                    return y;
+                }
+            }
+        }
+    }
+    return size;
+}
+
+struct OcclusionBuffer {
+    static constexpr int WIDTH = 256;
+    static constexpr int HEIGHT = 128;
+    static constexpr int NUM_BANDS = 4;  // threads rasterizing rows
+    static constexpr int HIZ_LEVELS = 6; // level 0 is the full buffer
+    // how much nearer (relative) an occluder has to be, so a chunk isn't
+    // hidden by the box of its own solid bottom through rounding
+    static constexpr float DEPTH_BIAS = 1.001f;
+
+    std::vector<float> levels[HIZ_LEVELS];
+
+    OcclusionBuffer() = default;
+    OcclusionBuffer(const OcclusionBuffer &) = delete;
+    OcclusionBuffer &operator=(const OcclusionBuffer &) = delete;
+    ~OcclusionBuffer();
+
+    void render(const std::vector<OcclusionBox> &occluders,
+                const glm::mat4 &viewProj, glm::vec3 cameraPos, float zNear);
+    bool isOccluded(const OcclusionBox &box) const;
+
+  private:
+    struct Edge {
+        float a, b, c; // a * x + b * y + c, positive inside
+    };
+    struct ScreenTriangle {
+        Edge edges[3];
+        Edge depth; // 1/w plane
+        int minX, maxX, minY, maxY;
+    };
+
+    std::vector<ScreenTriangle> triangles;
+    glm::mat4 viewProj;
+    float zNear;
+
+    // screen position and 1/w of a world point, false if it's behind the
+    // near plane
+    bool project(glm::vec3 p, glm::vec3 &out) const;
+    void addTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2);
+    void rasterizeBand(int y0, int y1);
+    void buildHiZ();
+
+    // bands 1..NUM_BANDS-1, each frame bumps bandFrame and waits for
+    // bandsLeft to get back to 0
+    std::vector<std::thread> bandWorkers;
+    std::mutex bandMutex;
+    std::condition_variable bandStart;
+    std::condition_variable bandDone;
+    uint64_t bandFrame = 0;
+    int bandsLeft = 0;
+    bool bandStop = false;
+    void bandWorker(int band);
+};
+
+OcclusionBuffer::~OcclusionBuffer() {
+    {
+        std::lock_guard<std::mutex> lock(bandMutex);
+        bandStop = true;
+    }
+    bandStart.notify_all();
+    for (std::thread &worker : bandWorkers) {
+        worker.join();
+    }
+}
+
+void OcclusionBuffer::bandWorker(int band) {
+    Profiler::get().setThreadName("occlusion");
+    constexpr int rowsPerBand = HEIGHT / NUM_BANDS;
+    uint64_t frame = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(bandMutex);
+            bandStart.wait(lock, [&] { return bandStop || bandFrame != frame; });
+            if (bandStop) {
+                return;
+            }
+            frame = bandFrame;
+        }
+        rasterizeBand(band * rowsPerBand, (band + 1) * rowsPerBand);
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(bandMutex);
+            last = --bandsLeft == 0;
+        }
+        if (last) {
+            bandDone.notify_one();
+        }
+    }
+}
+
+bool OcclusionBuffer::project(glm::vec3 p, glm::vec3 &out) const {
+    glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+    if (clip.w < zNear) {
+        return false;
+    }
+    float invW = 1.0f / clip.w;
+    out.x = (clip.x * invW * 0.5f + 0.5f) * WIDTH;
+    out.y = (clip.y * invW * 0.5f + 0.5f) * HEIGHT;
+    out.z = invW;
+    return true;
+}
+
+void OcclusionBuffer::addTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+    if (area < 0.0f) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+    if (area < 1e-6f) {
+        return;
+    }
+
+    ScreenTriangle tri;
+    const glm::vec3 *v[3] = {&v0, &v1, &v2};
+    for (int i = 0; i < 3; i++) {
+        const glm::vec3 &from = *v[i];
+        const glm::vec3 &to = *v[(i + 1) % 3];
+        tri.edges[i].a = -(to.y - from.y);
+        tri.edges[i].b = to.x - from.x;
+        tri.edges[i].c = -(tri.edges[i].a * from.x + tri.edges[i].b * from.y);
+    }
+
+    // edge i is opposite vertex (i + 2) % 3, so that vertex's barycentric
+    // weight is edge i / area
+    tri.depth = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 3; i++) {
+        float z = v[(i + 2) % 3]->z / area;
+        tri.depth.a += tri.edges[i].a * z;
+        tri.depth.b += tri.edges[i].b * z;
+        tri.depth.c += tri.edges[i].c * z;
+    }
+
+    tri.minX = std::max(0, (int)std::floor(std::min({v0.x, v1.x, v2.x})));
+    tri.maxX = std::min(WIDTH - 1, (int)std::ceil(std::max({v0.x, v1.x, v2.x})));
+    tri.minY = std::max(0, (int)std::floor(std::min({v0.y, v1.y, v2.y})));
+    tri.maxY =
+        std::min(HEIGHT - 1, (int)std::ceil(std::max({v0.y, v1.y, v2.y})));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+        return;
+    }
+    triangles.push_back(tri);
+}
+
+void OcclusionBuffer::render(const std::vector<OcclusionBox> &occluders,
+                             const glm::mat4 &_viewProj, glm::vec3 cameraPos,
+                             float _zNear) {
+    viewProj = _viewProj;
+    zNear = _zNear;
+    for (int l = 0; l < HIZ_LEVELS; l++) {
+        levels[l].assign((WIDTH >> l) * (HEIGHT >> l), 0.0f);
+    }
+
+    // corners are indexed by bits, 1 = x, 2 = y, 4 = z
+    static constexpr int FACES[6][4] = {
+        {0, 2, 6, 4}, {1, 3, 7, 5}, // -x, +x
+        {0, 1, 5, 4}, {2, 3, 7, 6}, // -y, +y
+        {0, 1, 3, 2}, {4, 5, 7, 6}, // -z, +z
+    };
+
+    triangles.clear();
+    for (const OcclusionBox &box : occluders) {
+        glm::vec3 screen[8];
+        bool behind = false;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner = {(i & 1) ? box.max.x : box.min.x,
+                                (i & 2) ? box.max.y : box.min.y,
+                                (i & 4) ? box.max.z : box.min.z};
+            behind |= !project(corner, screen[i]);
+        }
+        // boxes crossing the near plane would need clipping, they're
+        // rare enough to just leave out
+        if (behind) {
+            continue;
+        }
+
+        for (int f = 0; f < 6; f++) {
+            // only the faces pointing at the camera
+            int axis = f / 2;
+            bool positive = f % 2;
+            float plane = positive ? box.max[axis] : box.min[axis];
+            if (positive ? cameraPos[axis] <= plane
+                         : cameraPos[axis] >= plane) {
+                continue;
+            }
+            const int *q = FACES[f];
+            addTriangle(screen[q[0]], screen[q[1]], screen[q[2]]);
+            addTriangle(screen[q[0]], screen[q[2]], screen[q[3]]);
+        }
+    }
+
+    if (bandWorkers.empty()) {
+        for (int b = 1; b < NUM_BANDS; b++) {
+            bandWorkers.emplace_back(&OcclusionBuffer::bandWorker, this, b);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(bandMutex);
+        bandsLeft = NUM_BANDS - 1;
+        bandFrame++;
+    }
+    bandStart.notify_all();
+    rasterizeBand(0, HEIGHT / NUM_BANDS);
+    {
+        std::unique_lock<std::mutex> lock(bandMutex);
+        bandDone.wait(lock, [&] { return bandsLeft == 0; });
+    }
+
+    buildHiZ();
+}
+
+void OcclusionBuffer::rasterizeBand(int y0, int y1) {
+    PROFILE_SCOPE("occlusion raster");
+    float *buffer = levels[0].data();
+    for (const ScreenTriangle &tri : triangles) {
+        int minY = std::max(tri.minY, y0);
+        int maxY = std::min(tri.maxY, y1 - 1);
+        int startX = tri.minX & ~3;
+        const Edge *e = tri.edges;
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float *row = buffer + y * WIDTH;
+#ifdef OCCLUSION_SSE2
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+            const __m128 e0a = _mm_set1_ps(e[0].a);
+            const __m128 e1a = _mm_set1_ps(e[1].a);
+            const __m128 e2a = _mm_set1_ps(e[2].a);
+            const __m128 za = _mm_set1_ps(tri.depth.a);
+            const __m128 e0 = _mm_set1_ps(e[0].b * py + e[0].c);
+            const __m128 e1 = _mm_set1_ps(e[1].b * py + e[1].c);
+            const __m128 e2 = _mm_set1_ps(e[2].b * py + e[2].c);
+            const __m128 z = _mm_set1_ps(tri.depth.b * py + tri.depth.c);
+            for (int x = startX; x <= tri.maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+                __m128 inside = _mm_and_ps(
+                    _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(e0a, px), e0), zero),
+                    _mm_and_ps(
+                        _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(e1a, px), e1), zero),
+                        _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(e2a, px), e2),
+                                     zero)));
+                // depth is positive, so masked out lanes (0) never win
+                __m128 depth =
+                    _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(za, px), z));
+                _mm_storeu_ps(row + x,
+                              _mm_max_ps(_mm_loadu_ps(row + x), depth));
+            }
+#else
+            for (int x = startX; x <= tri.maxX; x++) {
+                float px = x + 0.5f;
+                if (e[0].a * px + e[0].b * py + e[0].c > 0.0f &&
+                    e[1].a * px + e[1].b * py + e[1].c > 0.0f &&
+                    e[2].a * px + e[2].b * py + e[2].c > 0.0f) {
+                    float depth =
+                        tri.depth.a * px + tri.depth.b * py + tri.depth.c;
+                    row[x] = std::max(row[x], depth);
+                }
+            }
+#endif
+        }
+    }
+}
+
+// each level keeps the farthest (smallest 1/w) of the 4 texels below it
+void OcclusionBuffer::buildHiZ() {
+    PROFILE_SCOPE("occlusion hi-z");
+    for (int l = 1; l < HIZ_LEVELS; l++) {
+        int width = WIDTH >> l;
+        int height = HEIGHT >> l;
+        const float *src = levels[l - 1].data();
+        float *dst = levels[l].data();
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float *s = src + (y * 2) * (width * 2) + x * 2;
+                dst[y * width + x] = std::min(std::min(s[0], s[1]),
+                                              std::min(s[width * 2],
+                                                       s[width * 2 + 1]));
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::isOccluded(const OcclusionBox &box) const {
+    float minX = WIDTH, maxX = 0.0f, minY = HEIGHT, maxY = 0.0f;
+    float nearest = 0.0f;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner = {(i & 1) ? box.max.x : box.min.x,
+                            (i & 2) ? box.max.y : box.min.y,
+                            (i & 4) ? box.max.z : box.min.z};
+        glm::vec3 screen;
+        if (!project(corner, screen)) {
+            return false; // crosses the near plane, right in front of us
+        }
+        minX = std::min(minX, screen.x);
+        maxX = std::max(maxX, screen.x);
+        minY = std::min(minY, screen.y);
+        maxY = std::max(maxY, screen.y);
+        nearest = std::max(nearest, screen.z);
+    }
+
+    int x0 = std::max(0, (int)std::floor(minX));
+    int x1 = std::min(WIDTH - 1, (int)std::ceil(maxX));
+    int y0 = std::max(0, (int)std::floor(minY));
+    int y1 = std::min(HEIGHT - 1, (int)std::ceil(maxY));
+    if (x0 > x1 || y0 > y1) {
+        return false; // off screen, that's the frustum test's job
+    }
+
+    // coarsest needed level where the box covers at most 4x4 texels
+    int level = 0;
+    while (level < HIZ_LEVELS - 1 &&
+           std::max(x1 - x0, y1 - y0) >> level > 3) {
+        level++;
+    }
+    int width = WIDTH >> level;
+    const float *hiz = levels[level].data();
+    float threshold = nearest * DEPTH_BIAS;
+    for (int y = y0 >> level; y <= y1 >> level; y++) {
+        for (int x = x0 >> level; x <= x1 >> level; x++) {
+            if (hiz[y * width + x] <= threshold) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+#endif // OCCLUSIONCULLING_H
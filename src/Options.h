@@ -0,0 +1,136 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+    Command line options.
+        --headless        no window, render offscreen along a scripted
+                          camera path and write a report, see Headless.h
+        --frames N        frames to run in headless mode
+        --report FILE     where the headless report goes
+        --record FILE     save the camera of every frame, see CameraPath.h
+        --replay FILE     headless, fly a recorded camera path instead of
+                          the scripted one, one frame per recorded frame
+        --world DIR       load saved chunks from DIR instead of generating
+                          them, and save the generated ones there on exit,
+                          see WorldStorage.h
+        --mesh-cache FILE keep finished chunk meshes in FILE and reuse
+                          them for unchanged chunks, see MeshCache.h
+        --mesh-cache-mb N size of the mesh cache file (default 256)
+
+    voxel-bench (src/bench.cpp) has its own, see BenchOptions.
+*/
+
+struct AppOptions {
+    bool headless = false;
+    int frames = 600;
+    std::string reportPath = "report.json";
+    std::string recordPath; // empty = not recording
+    std::string replayPath; // empty = ScriptedCameraPath
+    std::string worldPath;  // empty = nothing saved
+    std::string meshCachePath; // empty = every chunk is meshed
+    int meshCacheMb = 256;
+};
+
+// returns false (after printing usage) on anything it doesn't understand
+bool ParseOptions(int argc, char **argv, AppOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (std::strcmp(arg, "--frames") == 0 && hasValue) {
+            options.frames = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--report") == 0 && hasValue) {
+            options.reportPath = argv[++i];
+        } else if (std::strcmp(arg, "--record") == 0 && hasValue) {
+            options.recordPath = argv[++i];
+        } else if (std::strcmp(arg, "--replay") == 0 && hasValue) {
+            options.replayPath = argv[++i];
+            options.headless = true;
+        } else if (std::strcmp(arg, "--world") == 0 && hasValue) {
+            options.worldPath = argv[++i];
+        } else if (std::strcmp(arg, "--mesh-cache") == 0 && hasValue) {
+            options.meshCachePath = argv[++i];
+        } else if (std::strcmp(arg, "--mesh-cache-mb") == 0 && hasValue) {
+            options.meshCacheMb = std::atoi(argv[++i]);
+        } else {
+            std::printf("unknown option: %s\n", arg);
+            std::printf("usage: %s [--headless] [--frames N] [--report FILE] "
+                        "[--record FILE] [--replay FILE] [--world DIR] "
+                        "[--mesh-cache FILE] [--mesh-cache-mb N]\n",
+                        argv[0]);
+            return false;
+        }
+    }
+    if (options.frames <= 0) {
+        std::printf("--frames needs a positive number\n");
+        return false;
+    }
+    if (options.meshCacheMb <= 0) {
+        std::printf("--mesh-cache-mb needs a positive number\n");
+        return false;
+    }
+    if (options.headless && !options.recordPath.empty()) {
+        std::printf("--record needs a window to fly around in\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+    voxel-bench options.
+        --chunks N        chunks generated and meshed per generator
+        --entities N      entities stepped in the ECS workload
+        --steps N         ECS steps
+        --frusta N        scripted camera frusta in the culling workload
+        --seed N          terrain generator seed
+        --report FILE     where the JSON goes
+*/
+struct BenchOptions {
+    int chunks = 1024;
+    int entities = 4000;
+    int steps = 600;
+    int frusta = 256;
+    int seed = 1337;
+    std::string reportPath = "bench.json";
+};
+
+bool ParseBenchOptions(int argc, char **argv, BenchOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(arg, "--chunks") == 0 && hasValue) {
+            options.chunks = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--entities") == 0 && hasValue) {
+            options.entities = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--steps") == 0 && hasValue) {
+            options.steps = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--frusta") == 0 && hasValue) {
+            options.frusta = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = std::atoi(argv[++i]);
+        } else if (std::strcmp(arg, "--report") == 0 && hasValue) {
+            options.reportPath = argv[++i];
+        } else {
+            std::printf("unknown option: %s\n", arg);
+            std::printf("usage: %s [--chunks N] [--entities N] [--steps N] "
+                        "[--frusta N] [--seed N] [--report FILE]\n",
+                        argv[0]);
+            return false;
+        }
+    }
+    if (options.chunks <= 0 || options.entities <= 0 || options.steps <= 0 ||
+        options.frusta <= 0) {
+        std::printf("--chunks, --entities, --steps and --frusta need positive "
+                    "numbers\n");
+        return false;
+    }
+    return true;
+}
+
+#endif // OPTIONS_H
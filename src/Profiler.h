@@ -0,0 +1,245 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+    Scoped timer profiler.
+
+        void Chunk::createMesh(...) {
+            PROFILE_SCOPE("mesh");
+            ...
+        }
+
+    Every thread writes its finished scopes into its own ring buffer, a
+    single producer / single consumer queue with no locks on the hot path.
+    The main thread drains all rings once a frame in Profiler::endFrame and
+    keeps the last HISTORY_FRAMES frames around for the ImGui timeline
+    (ProfilerWindow.h) and for dumpChromeTrace, which writes a file that
+    chrome://tracing or https://ui.perfetto.dev can open.
+
+    Build with PROFILER_ENABLED=0 to compile the scopes out completely. When
+    compiled in but switched off at runtime a scope costs one relaxed
+    atomic load.
+    Names have to be string literals (or live forever), only the pointer
+    is stored.
+*/
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t startNs;
+    uint64_t endNs;
+    uint32_t depth;  // nesting on its thread, 0 = outermost
+    uint32_t thread; // index into Profiler::threadNames
+};
+
+// one per thread, written by its thread, read by the main thread
+struct ProfileRing {
+    static constexpr size_t CAPACITY = 8192; // power of 2
+
+    ProfileEvent events[CAPACITY];
+    std::atomic<uint64_t> head{0}; // next write, only the owner moves it
+    std::atomic<uint64_t> tail{0}; // next read, only the reader moves it
+    std::atomic<bool> inUse{true}; // false once the thread has exited
+    uint32_t thread = 0;
+    uint32_t depth = 0;
+    uint64_t dropped = 0; // events lost because the reader fell behind
+
+    inline void push(const ProfileEvent &event) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+            dropped++;
+            return;
+        }
+        events[h & (CAPACITY - 1)] = event;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct ProfileFrame {
+    uint64_t startNs;
+    uint64_t endNs;
+    std::vector<ProfileEvent> events;
+};
+
+struct Profiler {
+    static constexpr size_t HISTORY_FRAMES = 300;
+
+    std::atomic<bool> enabled{false};
+    bool paused = false; // keep showing the same frames in the timeline
+    std::deque<ProfileFrame> frames;
+    std::vector<std::string> threadNames;
+
+    static Profiler &get() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static inline uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - get().epoch)
+            .count();
+    }
+
+    ProfileRing *threadRing();
+    void setThreadName(const char *name);
+    std::vector<std::string> getThreadNames();
+    void endFrame();
+    bool dumpChromeTrace(const std::string &path);
+
+  private:
+    std::chrono::steady_clock::time_point epoch =
+        std::chrono::steady_clock::now();
+    std::mutex ringsMutex; // only taken when a thread gets its ring
+    std::vector<ProfileRing *> rings;
+    uint64_t frameStartNs = 0;
+};
+
+// hands the ring back when its thread exits, so the short lived std::async
+// threads reuse rings instead of leaking one each
+struct ProfileRingHandle {
+    ProfileRing *ring = nullptr;
+    ~ProfileRingHandle() {
+        if (ring != nullptr) {
+            ring->depth = 0;
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+ProfileRing *Profiler::threadRing() {
+    thread_local ProfileRingHandle handle;
+    if (handle.ring != nullptr) {
+        return handle.ring;
+    }
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (ProfileRing *ring : rings) {
+        // only take rings that have been drained, so the events of the
+        // old thread keep their thread index
+        if (!ring->inUse.load(std::memory_order_acquire) &&
+            ring->head.load() == ring->tail.load()) {
+            ring->inUse.store(true);
+            handle.ring = ring;
+            return ring;
+        }
+    }
+    ProfileRing *ring = new ProfileRing();
+    ring->thread = (uint32_t)rings.size();
+    rings.push_back(ring);
+    threadNames.push_back("thread " + std::to_string(ring->thread));
+    handle.ring = ring;
+    return ring;
+}
+
+void Profiler::setThreadName(const char *name) {
+    ProfileRing *ring = threadRing();
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    threadNames[ring->thread] = name;
+}
+
+std::vector<std::string> Profiler::getThreadNames() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    return threadNames;
+}
+
+// call once a frame from the main thread
+void Profiler::endFrame() {
+    uint64_t frameEndNs = now();
+    ProfileFrame frame = {frameStartNs, frameEndNs, {}};
+    frameStartNs = frameEndNs;
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (ProfileRing *ring : rings) {
+        uint64_t t = ring->tail.load(std::memory_order_relaxed);
+        uint64_t h = ring->head.load(std::memory_order_acquire);
+        for (; t < h; t++) {
+            frame.events.push_back(ring->events[t & (ProfileRing::CAPACITY - 1)]);
+        }
+        ring->tail.store(h, std::memory_order_release);
+    }
+
+    if (paused || frame.events.empty()) {
+        return;
+    }
+    frames.push_back(std::move(frame));
+    while (frames.size() > HISTORY_FRAMES) {
+        frames.pop_front();
+    }
+}
+
+// Trace Event Format, complete ("X") events in microseconds
+bool Profiler::dumpChromeTrace(const std::string &path) {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == NULL) {
+        return false;
+    }
+    std::vector<std::string> names = getThreadNames();
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (size_t t = 0; t < names.size(); t++) {
+        std::fprintf(file,
+                     "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                     "\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                     first ? "" : ",\n", t, names[t].c_str());
+        first = false;
+    }
+    for (const ProfileFrame &frame : frames) {
+        for (const ProfileEvent &event : frame.events) {
+            std::fprintf(file,
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,"
+                         "\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         first ? "" : ",\n", event.name, event.thread,
+                         event.startNs / 1000.0,
+                         (event.endNs - event.startNs) / 1000.0);
+            first = false;
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    std::fclose(file);
+    return true;
+}
+
+struct ProfileScope {
+    const char *name;
+    ProfileRing *ring = nullptr;
+    uint64_t startNs;
+
+    inline ProfileScope(const char *_name) : name(_name) {
+        if (!Profiler::get().enabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        ring = Profiler::get().threadRing();
+        ring->depth++;
+        startNs = Profiler::now();
+    }
+
+    inline ~ProfileScope() {
+        if (ring == nullptr) {
+            return;
+        }
+        ring->depth--;
+        ring->push({name, startNs, Profiler::now(), ring->depth, ring->thread});
+    }
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,171 @@
+#ifndef PROFILERWINDOW_H
+#define PROFILERWINDOW_H
+
+#include "Profiler.h"
+
+#include "imgui.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+/*
+    ImGui view of the profiler: a timeline of one frame with a row per
+    thread and a lane per nesting depth, and a table of the total time per
+    scope name in that frame.
+*/
+
+static ImU32 profileColor(const char *name) {
+    // same colour for the same name every frame
+    unsigned int hash = 2166136261u;
+    for (const char *c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return IM_COL32(90 + hash % 140, 90 + (hash >> 8) % 140,
+                    90 + (hash >> 16) % 140, 255);
+}
+
+void DrawProfilerWindow() {
+    Profiler &profiler = Profiler::get();
+    static int selectedFrame = -1; // -1 = follow the newest frame
+    static char status[64] = "";
+
+    ImGui::Begin("Profiler");
+    bool enabled = profiler.enabled.load();
+    if (ImGui::Checkbox("enabled", &enabled)) {
+        profiler.enabled.store(enabled);
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("pause", &profiler.paused);
+    ImGui::SameLine();
+    if (ImGui::Button("dump trace")) {
+        std::snprintf(status, sizeof(status), "%s",
+                      profiler.dumpChromeTrace("trace.json")
+                          ? "wrote trace.json"
+                          : "couldn't write trace.json");
+    }
+    ImGui::SameLine();
+    ImGui::TextUnformatted(status);
+
+    if (profiler.frames.empty()) {
+        ImGui::Text("no frames recorded");
+        ImGui::End();
+        return;
+    }
+
+    int frameCount = (int)profiler.frames.size();
+    int frameIndex = selectedFrame < 0 ? frameCount - 1
+                                       : std::min(selectedFrame, frameCount - 1);
+    if (ImGui::SliderInt("frame", &frameIndex, 0, frameCount - 1)) {
+        selectedFrame = frameIndex == frameCount - 1 ? -1 : frameIndex;
+    }
+    const ProfileFrame &frame = profiler.frames[frameIndex];
+
+    // some events started before the frame did (work left over from the
+    // last one), stretch the view to fit them
+    uint64_t start = frame.startNs;
+    uint64_t end = frame.endNs;
+    uint32_t threadCount = 0;
+    uint32_t maxDepth[64] = {0};
+    for (const ProfileEvent &event : frame.events) {
+        start = std::min(start, event.startNs);
+        end = std::max(end, event.endNs);
+        if (event.thread < 64) {
+            threadCount = std::max(threadCount, event.thread + 1);
+            maxDepth[event.thread] =
+                std::max(maxDepth[event.thread], event.depth + 1);
+        }
+    }
+    ImGui::Text("frame %.3f ms", (frame.endNs - frame.startNs) / 1e6);
+
+    // timeline
+    constexpr float laneHeight = 18.0f;
+    constexpr float labelWidth = 80.0f;
+    std::vector<std::string> threadNames = profiler.getThreadNames();
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = std::max(100.0f, ImGui::GetContentRegionAvail().x - labelWidth);
+    float nsToPx = width / (float)std::max<uint64_t>(1, end - start);
+
+    float rowY[64];
+    float y = origin.y;
+    for (uint32_t t = 0; t < threadCount; t++) {
+        rowY[t] = y;
+        if (maxDepth[t] > 0) {
+            drawList->AddText(ImVec2(origin.x, y), IM_COL32(255, 255, 255, 255),
+                              t < threadNames.size() ? threadNames[t].c_str()
+                                                     : "?");
+            y += maxDepth[t] * laneHeight + 4.0f;
+        }
+    }
+
+    const ProfileEvent *hovered = nullptr;
+    for (const ProfileEvent &event : frame.events) {
+        if (event.thread >= 64) {
+            continue;
+        }
+        ImVec2 min(origin.x + labelWidth + (event.startNs - start) * nsToPx,
+                   rowY[event.thread] + event.depth * laneHeight);
+        ImVec2 max(std::max(min.x + 1.0f,
+                            origin.x + labelWidth +
+                                (event.endNs - start) * nsToPx),
+                   min.y + laneHeight - 1.0f);
+        drawList->AddRectFilled(min, max, profileColor(event.name));
+        if (max.x - min.x > 40.0f) {
+            drawList->PushClipRect(min, max, true);
+            drawList->AddText(ImVec2(min.x + 2.0f, min.y + 1.0f),
+                              IM_COL32(0, 0, 0, 255), event.name);
+            drawList->PopClipRect();
+        }
+        if (ImGui::IsMouseHoveringRect(min, max)) {
+            hovered = &event;
+        }
+    }
+    ImGui::Dummy(ImVec2(labelWidth + width, y - origin.y));
+    if (hovered != nullptr) {
+        ImGui::SetTooltip("%s\n%.3f ms", hovered->name,
+                          (hovered->endNs - hovered->startNs) / 1e6);
+    }
+
+    // totals per name, biggest first
+    struct Total {
+        const char *name;
+        double ms;
+        int count;
+    };
+    std::vector<Total> totals;
+    for (const ProfileEvent &event : frame.events) {
+        auto it = std::find_if(totals.begin(), totals.end(), [&](const Total &t) {
+            return std::strcmp(t.name, event.name) == 0;
+        });
+        if (it == totals.end()) {
+            totals.push_back({event.name, 0.0, 0});
+            it = totals.end() - 1;
+        }
+        it->ms += (event.endNs - event.startNs) / 1e6;
+        it->count++;
+    }
+    std::sort(totals.begin(), totals.end(),
+              [](const Total &a, const Total &b) { return a.ms > b.ms; });
+
+    if (ImGui::BeginTable("##profileTotals", 3,
+                          ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("scope");
+        ImGui::TableSetupColumn("total ms");
+        ImGui::TableSetupColumn("calls");
+        ImGui::TableHeadersRow();
+        for (const Total &total : totals) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(total.name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", total.ms);
+            ImGui::TableNextColumn();
+            ImGui::Text("%d", total.count);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+#endif // PROFILERWINDOW_H
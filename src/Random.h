@@ -0,0 +1,56 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+/*
+    Stateless random numbers for terrain generation.
+
+    A number is a hash of (seed, chunk, counter), there is no generator
+    state to share between threads, so a block gets the same value no matter
+    which thread generates its chunk or in which order:
+
+        uint64_t key = ChunkRandomKey(seed, chunkX, chunkY, chunkZ);
+        uint64_t r = RandomAt(key, blockIndex);
+
+    The hash is splitmix64's finalizer, which passes BigCrush on a plain
+    counter, and the chunk key goes through it once per coordinate so
+    neighbouring chunks don't get related keys.
+    Use a different counter (or stream, for a different use in the same
+    chunk) for every number needed, the same counter always gives the same
+    number.
+*/
+
+inline uint64_t SplitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// chunk coordinates in any unit, as long as every chunk has its own
+inline uint64_t ChunkRandomKey(uint64_t seed, int x, int y, int z,
+                               uint32_t stream = 0) {
+    uint64_t key = SplitMix64(seed ^ ((uint64_t)stream << 32));
+    key = SplitMix64(key ^ (uint32_t)x);
+    key = SplitMix64(key ^ (uint32_t)y);
+    key = SplitMix64(key ^ (uint32_t)z);
+    return key;
+}
+
+inline uint64_t RandomAt(uint64_t key, uint64_t counter) {
+    return SplitMix64(key + counter * 0x9E3779B97F4A7C15ull);
+}
+
+// [0, range), range > 0. Multiply-shift instead of %, no modulo bias worth
+// talking about for small ranges
+inline uint32_t RandomRange(uint64_t key, uint64_t counter, uint32_t range) {
+    return (uint32_t)(((RandomAt(key, counter) >> 32) * range) >> 32);
+}
+
+// [0, 1)
+inline float RandomFloat(uint64_t key, uint64_t counter) {
+    return (float)(RandomAt(key, counter) >> 40) * (1.0f / 16777216.0f);
+}
+
+#endif // RANDOM_H
@@ -0,0 +1,147 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include "Chunk.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+    Sorted queue of chunk draws, rebuilt every frame from chunkRenderList.
+
+    Each draw gets a packed 64-bit sort key:
+        [63]      pass  - 0 opaque, 1 translucent
+        [62..32]  depth - bits of the squared camera distance (a positive
+                          float, so its bit pattern sorts like the value).
+                          Inverted for the translucent pass (back-to-front)
+        [31..0]   state - VAO id, so equal keys still group by GPU state
+
+    The items keep last frame's order and are re-sorted with an insertion
+    sort, which is close to O(n) when the camera only moved a little.
+*/
+
+struct RenderItem {
+    uint64_t key;
+    Chunk *chunk;
+};
+
+struct RenderQueue {
+    enum Pass {
+        PASS_OPAQUE = 0,
+        PASS_TRANSLUCENT,
+        NUM_PASSES,
+    };
+
+    // if the insertion sort has to move more than this many items per
+    // item, the order changed too much (teleport, fast turn) and we fall
+    // back to a full sort
+    static constexpr int MAX_SHIFTS_PER_ITEM = 8;
+
+    std::vector<RenderItem> items;
+    unsigned int frame = 0;
+
+    void build(const std::vector<Chunk *> &visible, glm::vec3 cameraPos);
+
+    static inline uint64_t makeKey(Pass pass, float distanceSq,
+                                   unsigned int state) {
+        uint32_t depth;
+        std::memcpy(&depth, &distanceSq, sizeof(depth));
+        depth &= 0x7FFFFFFF; // sign bit is always 0 for squared distances
+        if (pass == PASS_TRANSLUCENT) {
+            depth = ~depth & 0x7FFFFFFF;
+        }
+        return ((uint64_t)pass << 63) | ((uint64_t)depth << 32) | state;
+    }
+
+    static inline Pass getPass(uint64_t key) { return (Pass)(key >> 63); }
+
+  private:
+    static bool chunkHasPass(Chunk *chunk, Pass pass);
+    static float chunkDistanceSq(Chunk *chunk, glm::vec3 cameraPos);
+    void sort();
+};
+
+bool RenderQueue::chunkHasPass(Chunk *chunk, Pass pass) {
+    return pass == PASS_OPAQUE ? chunk->hasOpaque() : chunk->hasTranslucent();
+}
+
+static inline unsigned int passVaoId(Chunk *chunk, RenderQueue::Pass pass) {
+    return pass == RenderQueue::PASS_OPAQUE ? chunk->mesh.vaoId
+                                            : chunk->translucentMesh.vaoId;
+}
+
+float RenderQueue::chunkDistanceSq(Chunk *chunk, glm::vec3 cameraPos) {
+    constexpr float halfSize =
+        (Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE) / 2.0f;
+    glm::vec3 d = chunk->chunkPosition + glm::vec3(halfSize) - cameraPos;
+    return glm::dot(d, d);
+}
+
+void RenderQueue::build(const std::vector<Chunk *> &visible,
+                        glm::vec3 cameraPos) {
+    frame++;
+    for (Chunk *chunk : visible) {
+        chunk->visibleFrame = frame;
+    }
+
+    // keep the draws that are still visible in last frame's order, only
+    // refreshing their keys
+    size_t kept = 0;
+    for (RenderItem &item : items) {
+        Chunk *chunk = item.chunk;
+        Pass pass = getPass(item.key);
+        if (chunk->visibleFrame != frame || !chunkHasPass(chunk, pass)) {
+            continue;
+        }
+        chunk->queuedFrame[pass] = frame;
+        items[kept++] = {makeKey(pass, chunkDistanceSq(chunk, cameraPos),
+                                 passVaoId(chunk, pass)),
+                         chunk};
+    }
+    items.resize(kept);
+
+    // append draws that became visible this frame, a chunk has one draw
+    // per pass it has geometry for
+    for (Chunk *chunk : visible) {
+        for (int p = 0; p < NUM_PASSES; p++) {
+            Pass pass = (Pass)p;
+            if (chunk->queuedFrame[pass] == frame ||
+                !chunkHasPass(chunk, pass)) {
+                continue;
+            }
+            chunk->queuedFrame[pass] = frame;
+            items.push_back({makeKey(pass, chunkDistanceSq(chunk, cameraPos),
+                                     passVaoId(chunk, pass)),
+                             chunk});
+        }
+    }
+
+    sort();
+}
+
+void RenderQueue::sort() {
+    size_t shifts = 0;
+    size_t maxShifts = items.size() * MAX_SHIFTS_PER_ITEM;
+    for (size_t i = 1; i < items.size(); i++) {
+        RenderItem item = items[i];
+        size_t j = i;
+        while (j > 0 && items[j - 1].key > item.key) {
+            items[j] = items[j - 1];
+            j--;
+            shifts++;
+        }
+        items[j] = item;
+
+        if (shifts > maxShifts) {
+            std::sort(items.begin(), items.end(),
+                      [](const RenderItem &a, const RenderItem &b) {
+                          return a.key < b.key;
+                      });
+            return;
+        }
+    }
+}
+
+#endif // RENDERQUEUE_H
@@ -2,6 +2,12 @@
 #define TERRAINGENERATOR_H
 
 #include "Block.h"
+#include "Random.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <span>
 #include <glm/glm.hpp>
 
 /*
@@ -12,6 +18,14 @@ Base class for Terrain Generator:
     TerrainGenerator * terrainGenerator = new HillsTerrainGenerator(Chunk::CHUNK_SIZE, 1337);
 */
 
+// what a generator can promise about a column of chunks without generating
+// them, in world block y
+struct ColumnBounds {
+    int solidBelow = INT_MIN; // every block under it is solidType
+    int emptyAbove = INT_MAX; // every block from it up is air
+    BlockType solidType = BlockType::Stone;
+};
+
 class TerrainGenerator {
 protected:
     int CHUNK_SIZE;
@@ -20,13 +34,52 @@ protected:
     inline int getIndex(int x, int y, int z) const {
         return x + y * CHUNK_SIZE + z * CHUNK_SIZE * CHUNK_SIZE;
     }
+
+    // every block of layers y0 up to y1 set to type. For a given z those
+    // layers are one run of memory, so this is a fill per z.
+    // y0/y1 are clamped to the chunk, both fills take heights relative to
+    // the chunk's bottom that may be above or below it
+    void fillLayers(Block * blocks, int y0, int y1, BlockType type) const;
+    // blocks y0 up to y1 of column x/z set to type
+    void fillColumn(Block * blocks, int x, int z, int y0, int y1, BlockType type) const;
 public:
     // constructor
     TerrainGenerator(int CHUNK_SIZE, int seed);
+    virtual ~TerrainGenerator() {}
+
+    int getSeed() const { return seed; }
 
     // contains default random
     virtual void generateChunk(glm::vec3 position, Block * blocks); 
 
+    // positions[i] into blocks[i], for all of them. Generators that can
+    // share work between chunks (the columns of a stack of chunks, caches)
+    // override this, the default just calls generateChunk for each
+    virtual void generateChunks(std::span<const glm::vec3> positions,
+                                std::span<Block *const> blocks);
+
+    // top solid block (world block y) and its type for the column at world
+    // block (x, z), used to draw the far horizon.
+    // returns false if the generator has no single surface, like the default random
+    virtual bool sampleSurface(float x, float z, float &height, BlockType &type);
+
+    // bounds for the column of chunks with its minimum corner at world
+    // block x/z. Must be conservative: a chunk they cover completely must
+    // come out of generateChunk exactly as the bounds say.
+    // false if the generator can't tell cheaply, the default
+    virtual bool columnBounds(int x, int z, ColumnBounds &bounds);
+
+    // fills the chunk from columnBounds if they cover it completely (blocks
+    // start out as air), false if it needs generateChunk
+    bool generateFromBounds(glm::vec3 position, Block * blocks);
+
+    // noise evaluations made by generateChunk so far, voxel-bench reports
+    // them per chunk
+    std::atomic<uint64_t> noiseSamples{0};
+    // chunks generateFromBounds filled instead of generateChunk
+    std::atomic<uint64_t> skippedEmpty{0};
+    std::atomic<uint64_t> skippedSolid{0};
+
 };
 
 
@@ -43,21 +96,86 @@ Generate chunk:
     override this method in custom terrain generators
 */
 void TerrainGenerator::generateChunk(glm::vec3 position, Block * blocks) {
+    // numbers come from the seed, the chunk and the block index (Random.h),
+    // not std::rand(), so every chunk is the same whatever thread makes it
+    int chunkX = (int)std::floor(position.x / CHUNK_SIZE);
+    int chunkY = (int)std::floor(position.y / CHUNK_SIZE);
+    int chunkZ = (int)std::floor(position.z / CHUNK_SIZE);
+    uint64_t activeKey = ChunkRandomKey(seed, chunkX, chunkY, chunkZ, 0);
+    uint64_t typeKey = ChunkRandomKey(seed, chunkX, chunkY, chunkZ, 1);
+
     // iterate blocks in chunk
     for (int x = 0; x < CHUNK_SIZE; x++) {
         for (int y = 0; y < CHUNK_SIZE; y++) {
             for (int z = 0; z < CHUNK_SIZE; z++) {
                 int index = getIndex(x, y, z);
-                // NOTE: there seems to be a "pattern" in some chunks - is the same seed be initted across threads?
-                // seems like it does: https://en.cppreference.com/w/cpp/numeric/random/rand
-                blocks[index].isActive = (std::rand() % 2 == 0) ? false : true;
+                blocks[index].isActive = RandomAt(activeKey, index) & 1;
                 // make randint 1-7
-                blocks[index].blockType = BlockType((std::rand() % 6) + 1);
+                blocks[index].blockType =
+                    BlockType(RandomRange(typeKey, index, 6) + 1);
                 // blocks[index].isActive = true;
             }
         }
     }
 }
 
+void TerrainGenerator::generateChunks(std::span<const glm::vec3> positions,
+                                      std::span<Block *const> blocks) {
+    for (size_t i = 0; i < positions.size(); i++) {
+        generateChunk(positions[i], blocks[i]);
+    }
+}
+
+void TerrainGenerator::fillLayers(Block * blocks, int y0, int y1, BlockType type) const {
+    y0 = std::max(y0, 0);
+    y1 = std::min(y1, CHUNK_SIZE);
+    if (y1 <= y0) {
+        return;
+    }
+    Block block;
+    block.isActive = true;
+    block.blockType = type;
+    for (int z = 0; z < CHUNK_SIZE; z++) {
+        Block *layers = blocks + getIndex(0, 0, z);
+        std::fill(layers + y0 * CHUNK_SIZE, layers + y1 * CHUNK_SIZE, block);
+    }
+}
+
+void TerrainGenerator::fillColumn(Block * blocks, int x, int z, int y0, int y1,
+                                  BlockType type) const {
+    Block *column = blocks + getIndex(x, 0, z);
+    y1 = std::min(y1, CHUNK_SIZE);
+    for (int y = std::max(y0, 0); y < y1; y++) {
+        column[y * CHUNK_SIZE].isActive = true;
+        column[y * CHUNK_SIZE].blockType = type;
+    }
+}
+
+bool TerrainGenerator::columnBounds(int x, int z, ColumnBounds &bounds) {
+    return false;
+}
+
+bool TerrainGenerator::generateFromBounds(glm::vec3 position, Block * blocks) {
+    ColumnBounds bounds;
+    if (!columnBounds((int)position.x, (int)position.z, bounds)) {
+        return false;
+    }
+    int bottom = (int)position.y;
+    if (bottom >= bounds.emptyAbove) {
+        skippedEmpty.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (bottom + CHUNK_SIZE <= bounds.solidBelow) {
+        fillLayers(blocks, 0, CHUNK_SIZE, bounds.solidType);
+        skippedSolid.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool TerrainGenerator::sampleSurface(float x, float z, float &height, BlockType &type) {
+    return false;
+}
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,342 @@
+#ifndef WORLD_STORAGE_H
+#define WORLD_STORAGE_H
+
+#include "Block.h"
+#include "ChunkCodec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+    Chunks saved to disk, a directory of region files:
+
+        world/r.<x>.<y>.<z>.vxr   REGION_SIZE^3 chunks each
+
+    A region file starts with a header and an offset table, one entry per
+    chunk (x + y * REGION_SIZE + z * REGION_SIZE^2):
+
+        "VXRG", version, 8 unused bytes
+        { first sector, payload bytes (0 = not saved) } * REGION_CHUNKS
+        payloads, each starting on a REGION_SECTOR boundary
+
+    Payloads are ChunkCodec.h's. The table is read once when the region is
+    opened and kept in memory, after that loading a chunk is a single
+    pread of its payload. Saving writes the payload in place if it still
+    fits in its old sectors and at the end of the file if not (the old
+    sectors are left unused, there's no compaction), then its table entry.
+    A moved payload is written before the entry pointing at it, so a crash
+    in between leaves the old version. One cut short in place fails to
+    decode and the chunk is generated again.
+
+    Numbers are little endian. Windows has no pread, reads and writes
+    there seek under a lock.
+*/
+
+class RegionFile {
+  public:
+    static constexpr int REGION_SIZE = 32; // chunks per side
+    static constexpr int REGION_CHUNKS = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+    static constexpr int REGION_SECTOR = 256;
+    static constexpr uint32_t VERSION = 1;
+
+    RegionFile() {}
+    ~RegionFile() { close(); }
+    RegionFile(const RegionFile &) = delete;
+    RegionFile &operator=(const RegionFile &) = delete;
+
+    // opens path, creating it if it isn't there
+    bool open(const std::string &path);
+    void close();
+
+    // payload of chunk index, false if it was never saved
+    bool read(int index, std::vector<uint8_t> &payload);
+    bool write(int index, const uint8_t *payload, size_t size);
+
+    // the same in steps, for ChunkIO.h to batch the payload reads and
+    // writes itself:
+    //     find -> read extent.size bytes at extent.offset
+    //     allocate -> write the payload there -> commit
+    struct Extent {
+        uint64_t offset;
+        uint32_t size;
+    };
+    bool find(int index, Extent &extent);
+    Extent allocate(int index, size_t size);
+    bool commit(int index, const Extent &extent);
+    int descriptor() const { return fd; }
+    bool readAt(void *data, size_t size, uint64_t offset);
+    bool writeAt(const void *data, size_t size, uint64_t offset);
+
+  private:
+    struct Entry {
+        uint32_t sector;
+        uint32_t size;
+    };
+    static constexpr int HEADER_SIZE = 16;
+    static constexpr uint64_t TABLE_END = HEADER_SIZE + sizeof(Entry) * REGION_CHUNKS;
+
+    int fd = -1;
+    std::mutex mutex; // table and nextSector
+    std::vector<Entry> table;
+    uint32_t nextSector = 0;
+#ifdef _WIN32
+    std::mutex seekMutex; // seek + read/write
+#endif
+
+    static uint32_t sectorsFor(uint64_t size) {
+        return (uint32_t)((size + REGION_SECTOR - 1) / REGION_SECTOR);
+    }
+};
+
+#ifdef _WIN32
+bool RegionFile::readAt(void *data, size_t size, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(seekMutex);
+    return _lseeki64(fd, (__int64)offset, SEEK_SET) == (__int64)offset &&
+           _read(fd, data, (unsigned)size) == (int)size;
+}
+
+bool RegionFile::writeAt(const void *data, size_t size, uint64_t offset) {
+    std::lock_guard<std::mutex> lock(seekMutex);
+    return _lseeki64(fd, (__int64)offset, SEEK_SET) == (__int64)offset &&
+           _write(fd, data, (unsigned)size) == (int)size;
+}
+#else
+bool RegionFile::readAt(void *data, size_t size, uint64_t offset) {
+    uint8_t *p = (uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, (off_t)offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool RegionFile::writeAt(const void *data, size_t size, uint64_t offset) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, (off_t)offset);
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+#endif
+
+bool RegionFile::open(const std::string &path) {
+#ifdef _WIN32
+    fd = _open(path.c_str(), _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+    if (fd < 0) {
+        return false;
+    }
+
+    uint8_t header[HEADER_SIZE] = {'V', 'X', 'R', 'G'};
+    table.assign(REGION_CHUNKS, Entry{0, 0});
+    uint8_t existing[HEADER_SIZE];
+    if (readAt(existing, HEADER_SIZE, 0)) {
+        uint32_t version;
+        std::memcpy(&version, existing + 4, sizeof(version));
+        if (std::memcmp(existing, header, 4) != 0 || version != VERSION ||
+            !readAt(table.data(), sizeof(Entry) * REGION_CHUNKS, HEADER_SIZE)) {
+            std::printf("not a region file (or a different version): %s\n",
+                        path.c_str());
+            close();
+            return false;
+        }
+    } else {
+        // new file, header and an empty table
+        std::memcpy(header + 4, &VERSION, sizeof(VERSION));
+        if (!writeAt(header, HEADER_SIZE, 0) ||
+            !writeAt(table.data(), sizeof(Entry) * REGION_CHUNKS, HEADER_SIZE)) {
+            close();
+            return false;
+        }
+    }
+
+    nextSector = sectorsFor(TABLE_END);
+    for (const Entry &entry : table) {
+        if (entry.size > 0) {
+            nextSector = std::max(nextSector, entry.sector + sectorsFor(entry.size));
+        }
+    }
+    return true;
+}
+
+void RegionFile::close() {
+    if (fd < 0) {
+        return;
+    }
+#ifdef _WIN32
+    _close(fd);
+#else
+    ::close(fd);
+#endif
+    fd = -1;
+}
+
+bool RegionFile::find(int index, Extent &extent) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry &entry = table[index];
+    extent = {(uint64_t)entry.sector * REGION_SECTOR, entry.size};
+    return entry.size > 0;
+}
+
+// where a payload of size bytes for index goes: its old sectors if it
+// still fits, new ones at the end of the file if not. The table still
+// points at the old payload until commit
+RegionFile::Extent RegionFile::allocate(int index, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const Entry &entry = table[index];
+    uint32_t sector = entry.sector;
+    if (entry.size == 0 || sectorsFor(size) > sectorsFor(entry.size)) {
+        sector = nextSector;
+        nextSector += sectorsFor(size);
+    }
+    return {(uint64_t)sector * REGION_SECTOR, (uint32_t)size};
+}
+
+bool RegionFile::commit(int index, const Extent &extent) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry = {(uint32_t)(extent.offset / REGION_SECTOR), extent.size};
+    if (!writeAt(&entry, sizeof(Entry), HEADER_SIZE + sizeof(Entry) * (uint64_t)index)) {
+        return false;
+    }
+    table[index] = entry;
+    return true;
+}
+
+bool RegionFile::read(int index, std::vector<uint8_t> &payload) {
+    Extent extent;
+    if (!find(index, extent)) {
+        return false;
+    }
+    payload.resize(extent.size);
+    return readAt(payload.data(), extent.size, extent.offset);
+}
+
+bool RegionFile::write(int index, const uint8_t *payload, size_t size) {
+    Extent extent = allocate(index, size);
+    return writeAt(payload, size, extent.offset) && commit(index, extent);
+}
+
+/*
+    The region files of a world directory, opened as chunks in them are
+    first loaded or saved. Chunk coordinates are in chunks, the generator
+    position (in blocks) / CHUNK_SIZE. Safe to call from any thread.
+*/
+class WorldStorage {
+  public:
+    // creates directory if it isn't there
+    explicit WorldStorage(const std::string &directory) : directory(directory) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+
+    // false if the chunk was never saved (or can't be read), blocks are
+    // untouched then
+    bool loadChunk(int x, int y, int z, Block *blocks, int count);
+    bool saveChunk(int x, int y, int z, const Block *blocks, int count);
+
+    // for stats and voxel-bench
+    std::atomic<uint64_t> chunksLoaded{0};
+    std::atomic<uint64_t> chunksSaved{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> bytesWritten{0};
+
+    // region file chunk x/y/z is in and its index there, nullptr if it
+    // can't be opened
+    RegionFile *region(int x, int y, int z, int &index);
+    const std::string &path() const { return directory; }
+
+  private:
+    std::string directory;
+    std::mutex mutex; // regions
+    std::map<std::tuple<int, int, int>, std::unique_ptr<RegionFile>> regions;
+
+    static int floorDiv(int a, int b) { return (int)std::floor((float)a / b); }
+};
+
+RegionFile *WorldStorage::region(int x, int y, int z, int &index) {
+    constexpr int size = RegionFile::REGION_SIZE;
+    int rx = floorDiv(x, size), ry = floorDiv(y, size), rz = floorDiv(z, size);
+    index = (x - rx * size) + (y - ry * size) * size + (z - rz * size) * size * size;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<RegionFile> &file = regions[{rx, ry, rz}];
+    if (!file) {
+        file = std::make_unique<RegionFile>();
+        std::string name = "r." + std::to_string(rx) + "." + std::to_string(ry) +
+                           "." + std::to_string(rz) + ".vxr";
+        if (!file->open((std::filesystem::path(directory) / name).string())) {
+            file.reset();
+            return nullptr;
+        }
+    }
+    return file.get();
+}
+
+bool WorldStorage::loadChunk(int x, int y, int z, Block *blocks, int count) {
+    int index;
+    RegionFile *file = region(x, y, z, index);
+    thread_local std::vector<uint8_t> payload;
+    if (file == nullptr || !file->read(index, payload)) {
+        return false;
+    }
+    thread_local std::vector<Block> decoded;
+    decoded.resize(count);
+    if (!DecodeChunk(payload.data(), payload.size(), decoded.data(), count)) {
+        std::printf("corrupt chunk %d %d %d in %s, regenerating it\n", x, y, z,
+                    directory.c_str());
+        return false;
+    }
+    std::copy(decoded.begin(), decoded.end(), blocks);
+    chunksLoaded.fetch_add(1, std::memory_order_relaxed);
+    bytesRead.fetch_add(payload.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool WorldStorage::saveChunk(int x, int y, int z, const Block *blocks, int count) {
+    int index;
+    RegionFile *file = region(x, y, z, index);
+    thread_local std::vector<uint8_t> payload;
+    EncodeChunk(blocks, count, payload);
+    if (file == nullptr || !file->write(index, payload.data(), payload.size())) {
+        return false;
+    }
+    chunksSaved.fetch_add(1, std::memory_order_relaxed);
+    bytesWritten.fetch_add(payload.size(), std::memory_order_relaxed);
+    return true;
+}
+
+#endif // WORLD_STORAGE_H
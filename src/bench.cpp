@@ -0,0 +1,1151 @@
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "ChunkIO.h"
+#include "Decorations.h"
+#include "Ecs.h"
+#include "MemoryStats.h"
+#include "MeshCache.h"
+#include "Noise.h"
+#include "Options.h"
+#include "PhysicsSystem.h"
+#include "utils.h"
+#include "WorldStorage.h"
+#include "terrain/Biomes.h"
+#include "terrain/Caves.h"
+#include "terrain/Hills.h"
+#include "terrain/Plains.h"
+#include "terrain/Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iterator>
+#include <new>
+#include <thread>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h> // _aligned_malloc
+#endif
+
+/*
+    voxel-bench: the CPU side of the engine without a window or GL context.
+
+    Workloads, all single threaded and seeded so two runs do the same work:
+    - gen.<generator>   fill N chunks with every terrain generator, chunk by
+                        chunk and then as one generateChunks batch, any
+                        chunk the two disagree on fails the run
+                        (caves_per_voxel is caves with density evaluated
+                        at every block instead of every 4th)
+    - mesh.<generator>  mesh those chunks (Chunk::buildMesh, no upload)
+    - meshcache.<gen>   the default and hills meshes through MeshCache.h:
+                        into an empty cache, back from the reopened file,
+                        then twice through one a quarter of the size with
+                        a few hot chunks in between every other chunk
+                        (evictions, reinserts, whether the hot ones stayed).
+                        Any mesh that differs from the uncached one fails
+                        the run
+    - cull              frustum + cave culling over the hills chunks from a
+                        scripted set of cameras, then the occlusion buffer
+                        (OcclusionCulling.h) from the same cameras
+    - biomes            how many of the biomes chunks were blended
+    - decorate          trees and boulders over the hills chunks, once in
+                        order on one thread and once backwards on all cores,
+                        any chunk that ends up different fails the run
+    - storage.<gen>     save the hills (decorated) and default chunks to
+                        region files (WorldStorage.h) and load them back
+                        with a freshly opened storage, chunks and MB per
+                        second both ways, size on disk, any chunk that
+                        doesn't come back the same fails the run. The files
+                        were just written, loads come from the page cache
+    - io                the hills chunks through ChunkIO.h: save() per
+                        chunk on the caller (encode + queue), everything
+                        saved twice (the second replaces the first), loaded
+                        back before the flush (from the queue), flushed,
+                        then loaded by a fresh ChunkIO in one batch. Any
+                        chunk that doesn't come back the same fails the run
+    - startup           the engine's world streamed in (pregenerateChunks)
+                        on all cores from where the camera starts, without
+                        uploads: until the chunks around the camera are
+                        meshed and until all of them are. Any streamed mesh
+                        that differs from one built again from the final
+                        blocks fails the run
+    - ecs               step PhysicsSystem over M entities
+    - noise.2d/3d       batch noise (Noise.h) against stb_perlin, samples
+                        per second and the largest difference, more than
+                        NOISE_TOLERANCE fails the run
+    - determinism.<gen> every generator fills the same chunks on one thread
+                        in order and on all cores backwards (the second
+                        time skipping what columnBounds covers), any block
+                        that differs fails the run
+
+    Results go to a JSON file (--report) to compare between commits.
+    Allocations are counted by replacing the global operator new, the mesh
+    arrays are malloc'd and show up in memory_peak_bytes instead.
+*/
+
+Coordinator gCoordinator;
+
+// global allocation counters
+static std::atomic<uint64_t> gAllocCalls{0};
+static std::atomic<uint64_t> gAllocBytes{0};
+
+void *operator new(size_t size) {
+    gAllocCalls.fetch_add(1, std::memory_order_relaxed);
+    gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, std::align_val_t align) {
+    gAllocCalls.fetch_add(1, std::memory_order_relaxed);
+    gAllocBytes.fetch_add(size, std::memory_order_relaxed);
+    // aligned_alloc wants a multiple of the alignment
+    size_t alignment = (size_t)align;
+    size_t rounded =
+        (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+    void *p = _aligned_malloc(rounded, alignment);
+#else
+    void *p = std::aligned_alloc(alignment, rounded);
+#endif
+    if (p) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size, std::align_val_t align) {
+    return operator new(size, align);
+}
+
+// gcc -Wall flags free() on a pointer from operator new wherever a delete
+// gets inlined, so the other forms go through these two out of line
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void operator delete(void *p, std::align_val_t) noexcept {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+void operator delete[](void *p) noexcept { operator delete(p); }
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { operator delete(p); }
+void operator delete[](void *p, std::align_val_t align) noexcept {
+    operator delete(p, align);
+}
+void operator delete(void *p, size_t, std::align_val_t align) noexcept {
+    operator delete(p, align);
+}
+void operator delete[](void *p, size_t, std::align_val_t align) noexcept {
+    operator delete(p, align);
+}
+
+using BenchClock = std::chrono::steady_clock;
+
+static double nsSince(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start)
+        .count();
+}
+
+// allocations made since it was created
+struct AllocationScope {
+    uint64_t calls = gAllocCalls.load();
+    uint64_t bytes = gAllocBytes.load();
+
+    uint64_t callCount() const { return gAllocCalls.load() - calls; }
+    uint64_t byteCount() const { return gAllocBytes.load() - bytes; }
+};
+
+struct BenchResult {
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+
+    void add(const char *key, double value) { metrics.push_back({key, value}); }
+};
+
+/*
+    A side x LAYERS x side block of chunks laid out like the engine's world:
+    the top layer starts at world y -CHUNK_SIZE * BLOCK_RENDER_SIZE and x/z
+    are centred on 0.
+*/
+struct BenchWorld {
+    static constexpr int LAYERS = 4;
+    static constexpr int CHUNK_WORLD_SIZE =
+        Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE;
+
+    int side = 0;
+    std::vector<Chunk *> chunks; // x, then z, then layer (bottom first)
+
+    BenchWorld(int chunkCount) {
+        side = std::max(1, (int)std::lround(std::sqrt(chunkCount / (double)LAYERS)));
+        chunks.resize(side * side * LAYERS);
+        for (int y = 0; y < LAYERS; y++) {
+            for (int z = 0; z < side; z++) {
+                for (int x = 0; x < side; x++) {
+                    glm::vec3 position((x - side / 2) * CHUNK_WORLD_SIZE,
+                                       (y - LAYERS) * CHUNK_WORLD_SIZE,
+                                       (z - side / 2) * CHUNK_WORLD_SIZE);
+                    chunks[index(x, y, z)] = new Chunk(position, nullptr);
+                }
+            }
+        }
+    }
+
+    ~BenchWorld() {
+        for (Chunk *chunk : chunks) {
+            chunk->unload();
+            delete chunk;
+        }
+    }
+
+    int index(int x, int y, int z) const { return x + z * side + y * side * side; }
+
+    Chunk *get(int x, int y, int z) const {
+        if (x < 0 || x >= side || y < 0 || y >= LAYERS || z < 0 || z >= side) {
+            return nullptr;
+        }
+        return chunks[index(x, y, z)];
+    }
+
+    // same as ChunkManager::GetNeighbourhood
+    ChunkNeighbourhood neighbourhood(int x, int y, int z) const {
+        ChunkNeighbourhood neighbourhood;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    Chunk *neighbour = get(x + dx, y + dy, z + dz);
+                    if (neighbour != nullptr) {
+                        neighbourhood.blocks[(dx + 1) + (dy + 1) * 3 +
+                                             (dz + 1) * 9] = neighbour->blocks;
+                    }
+                }
+            }
+        }
+        return neighbourhood;
+    }
+};
+
+static uint64_t hashBlocks(const Chunk *chunk) {
+    uint64_t hash = 1469598103934665603ull; // FNV-1a
+    for (const Block &block : chunk->blocks) {
+        hash = (hash ^ (block.isActive ? block.blockType + 1 : 0)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// chunk by chunk with generator, then again with one generateChunks call
+// on batchGenerator (a fresh one, so neither starts with warm caches)
+static BenchResult benchGenerate(const char *name, TerrainGenerator *generator,
+                                 TerrainGenerator *batchGenerator,
+                                 BenchWorld &world) {
+    AllocationScope allocations;
+    uint64_t noiseSamples = generator->noiseSamples.load();
+    uint64_t skipped = generator->skippedEmpty + generator->skippedSolid;
+    BenchClock::time_point start = BenchClock::now();
+    for (Chunk *chunk : world.chunks) {
+        chunk->generate(generator);
+    }
+    double ns = nsSince(start);
+    noiseSamples = generator->noiseSamples.load() - noiseSamples;
+    skipped = generator->skippedEmpty + generator->skippedSolid - skipped;
+    uint64_t allocationCalls = allocations.callCount();
+    uint64_t allocationBytes = allocations.byteCount();
+
+    long long activeBlocks = 0;
+    std::vector<uint64_t> hashes;
+    for (Chunk *chunk : world.chunks) {
+        for (const Block &block : chunk->blocks) {
+            activeBlocks += block.isActive;
+        }
+        hashes.push_back(hashBlocks(chunk));
+        std::fill(std::begin(chunk->blocks), std::end(chunk->blocks), Block());
+    }
+
+    start = BenchClock::now();
+    Chunk::generateBatch(world.chunks, batchGenerator);
+    double batchNs = nsSince(start);
+    int mismatched = 0;
+    for (size_t i = 0; i < world.chunks.size(); i++) {
+        mismatched += hashBlocks(world.chunks[i]) != hashes[i];
+    }
+
+    size_t count = world.chunks.size();
+    BenchResult result = {std::string("gen.") + name, {}};
+    result.add("ns_per_chunk", ns / count);
+    result.add("active_blocks_per_chunk", (double)activeBlocks / count);
+    result.add("noise_samples_per_chunk", (double)noiseSamples / count);
+    result.add("skipped_chunks", (double)skipped);
+    result.add("allocations", (double)allocationCalls);
+    result.add("allocated_bytes", (double)allocationBytes);
+    result.add("chunks_per_sec", count / ns * 1e9);
+    result.add("batch_chunks_per_sec", count / batchNs * 1e9);
+    result.add("batch_mismatched_chunks", mismatched);
+    return result;
+}
+
+static BenchResult benchMesh(const char *name, BenchWorld &world) {
+    AllocationScope allocations;
+    double ns = 0.0;
+    long long vertices = 0;
+    long long triangles = 0;
+    for (int y = 0; y < BenchWorld::LAYERS; y++) {
+        for (int z = 0; z < world.side; z++) {
+            for (int x = 0; x < world.side; x++) {
+                Chunk *chunk = world.get(x, y, z);
+                ChunkNeighbourhood neighbourhood = world.neighbourhood(x, y, z);
+                BenchClock::time_point start = BenchClock::now();
+                chunk->buildMesh(neighbourhood);
+                ns += nsSince(start);
+                vertices += chunk->mesh.vertexCount +
+                            chunk->translucentMesh.vertexCount;
+                triangles += chunk->mesh.triangleCount +
+                             chunk->translucentMesh.triangleCount;
+            }
+        }
+    }
+    size_t count = world.chunks.size();
+    BenchResult result = {std::string("mesh.") + name, {}};
+    result.add("ns_per_chunk", ns / count);
+    result.add("vertices_per_chunk", (double)vertices / count);
+    result.add("triangles_per_chunk", (double)triangles / count);
+    result.add("allocations", (double)allocations.callCount());
+    result.add("allocated_bytes", (double)allocations.byteCount());
+    return result;
+}
+
+// both meshes and what buildMesh works out for visibility
+static uint64_t hashMeshes(const Chunk *chunk) {
+    uint64_t hash = Hash64(&chunk->faceConnectivity, sizeof(uint64_t),
+                           (uint64_t)chunk->solidLayers);
+    for (const ChunkMesh *mesh : {&chunk->mesh, &chunk->translucentMesh}) {
+        hash = Hash64(mesh->vertices, mesh->vertexCount * sizeof(int), hash);
+        hash = Hash64(mesh->indices, mesh->triangleCount * 3 * sizeof(unsigned int),
+                      hash);
+    }
+    return hash;
+}
+
+// the mesh cache: meshing into an empty one, the same chunks again from the
+// reopened file, then a cache a quarter of the size with a few chunks asked
+// for over and over, which eviction should keep (see MeshCache.h).
+// Expects world to be meshed already, without a cache
+static BenchResult benchMeshCache(const char *name, BenchWorld &world) {
+    std::filesystem::path file = std::filesystem::temp_directory_path() /
+                                 (std::string("voxel-bench-meshes-") + name + ".vxmc");
+    std::error_code error;
+    std::filesystem::remove(file, error);
+
+    size_t count = world.chunks.size();
+    std::vector<uint64_t> reference(count);
+    for (size_t i = 0; i < count; i++) {
+        reference[i] = hashMeshes(world.chunks[i]);
+    }
+    int mismatched = 0;
+    // chunks[i] through the cache, ns it took
+    auto remesh = [&](int i, MeshCache &cache) {
+        Chunk *chunk = world.chunks[i];
+        ChunkNeighbourhood neighbourhood = world.neighbourhood(
+            i % world.side, i / (world.side * world.side), i / world.side % world.side);
+        UnloadChunkMesh(chunk->mesh);
+        UnloadChunkMesh(chunk->translucentMesh);
+        BenchClock::time_point start = BenchClock::now();
+        chunk->buildMesh(neighbourhood, &cache);
+        double ns = nsSince(start);
+        mismatched += hashMeshes(chunk) != reference[i];
+        return ns;
+    };
+    // every chunk, with one of the first hotChunks in between each
+    auto meshAll = [&](MeshCache &cache, int hotChunks) {
+        double ns = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            ns += remesh((int)i, cache);
+            if (hotChunks > 0) {
+                remesh((int)i % hotChunks, cache);
+            }
+        }
+        return ns;
+    };
+
+    double missNs, hitNs;
+    double warmHitRate;
+    uint64_t usedBytes;
+    {
+        MeshCache cache(file.string(), 256ull << 20);
+        missNs = meshAll(cache, 0);
+        usedBytes = cache.bytesUsed();
+    }
+    {
+        // everything fits, all of it should come back from the file
+        MeshCache cache(file.string(), 256ull << 20);
+        hitNs = meshAll(cache, 0);
+        warmHitRate = cache.hitRate();
+        mismatched += cache.misses != 0;
+    }
+    std::filesystem::remove(file, error);
+
+    uint64_t evictions, reinserts;
+    double hotHitRate;
+    {
+        MeshCache cache(file.string(), usedBytes / 4);
+        int hotChunks = std::max(1, (int)count / 16);
+        meshAll(cache, hotChunks);
+        meshAll(cache, hotChunks);
+        evictions = cache.evictions;
+        reinserts = cache.reinserts;
+        // the hot chunks on their own, they should all still be there
+        uint64_t hits = cache.hits;
+        for (int i = 0; i < hotChunks; i++) {
+            remesh(i, cache);
+        }
+        hotHitRate = (double)(cache.hits - hits) / hotChunks;
+    }
+    std::filesystem::remove(file, error);
+
+    BenchResult result = {std::string("meshcache.") + name, {}};
+    result.add("miss_ns_per_chunk", missNs / count);
+    result.add("hit_ns_per_chunk", hitNs / count);
+    result.add("speedup", missNs / hitNs);
+    result.add("bytes_per_chunk", (double)usedBytes / count);
+    result.add("warm_hit_rate", warmHitRate);
+    result.add("small_evictions", (double)evictions);
+    result.add("small_reinserts", (double)reinserts);
+    result.add("small_hot_hit_rate", hotHitRate);
+    result.add("mismatched_meshes", mismatched);
+    return result;
+}
+
+// cameras on a lap around the middle of the world, some above the ground and
+// some inside it so the cave culling has something to do
+static Camera benchCamera(int frame, int frameCount, float radius) {
+    Camera camera;
+    float angle = (float)frame / frameCount * 2.0f * 3.14159265f;
+    camera.cameraPos = glm::vec3(radius * std::cos(angle),
+                                 -40.0f + 60.0f * std::sin(angle * 3.0f),
+                                 radius * std::sin(angle));
+    camera.yaw = glm::degrees(angle) + 120.0f;
+    camera.pitch = -20.0f;
+    glm::vec3 front;
+    front.x = std::cos(glm::radians(camera.yaw)) *
+              std::cos(glm::radians(camera.pitch));
+    front.y = std::sin(glm::radians(camera.pitch));
+    front.z = std::sin(glm::radians(camera.yaw)) *
+              std::cos(glm::radians(camera.pitch));
+    camera.cameraFront = glm::normalize(front);
+    camera.cameraRight =
+        glm::normalize(glm::cross(camera.cameraFront, camera.cameraUp));
+    camera.frustum = createFrustumFromCamera(camera);
+    return camera;
+}
+
+// the world has to be meshed first, that's where the connectivity comes from
+static BenchResult benchCull(BenchWorld &world, int frusta) {
+    constexpr float chunkWorldSize = BenchWorld::CHUNK_WORLD_SIZE;
+    // the traversal wants a cube, the layers above the chunks are empty
+    int gridSize = std::max(world.side, BenchWorld::LAYERS);
+    glm::vec3 gridOrigin((-world.side / 2) * chunkWorldSize,
+                         -BenchWorld::LAYERS * chunkWorldSize,
+                         (-world.side / 2) * chunkWorldSize);
+
+    AllocationScope allocations;
+    long long inFrustum = 0;
+    long long reachable = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int f = 0; f < frusta; f++) {
+        Camera camera =
+            benchCamera(f, frusta, world.side * chunkWorldSize * 0.25f);
+
+        auto inView = [&](glm::vec3 chunkPosition) -> bool {
+            glm::vec3 chunkCenter = chunkPosition + glm::vec3(chunkWorldSize / 2);
+            return camera.frustum.CubeInFrustum(chunkCenter, chunkWorldSize / 2,
+                                                chunkWorldSize / 2,
+                                                chunkWorldSize / 2);
+        };
+        for (Chunk *chunk : world.chunks) {
+            inFrustum += inView(chunk->chunkPosition);
+        }
+
+        glm::ivec3 cameraCoords =
+            glm::ivec3(glm::floor((camera.cameraPos - gridOrigin) / chunkWorldSize));
+        if (cameraCoords.x < 0 || cameraCoords.x >= gridSize ||
+            cameraCoords.y < 0 || cameraCoords.y >= gridSize ||
+            cameraCoords.z < 0 || cameraCoords.z >= gridSize) {
+            continue;
+        }
+        reachable += TraverseVisibleChunks(
+            gridSize, cameraCoords.x, cameraCoords.y, cameraCoords.z,
+            [&](int x, int y, int z) {
+                Chunk *chunk = world.get(x, y, z);
+                return chunk != nullptr ? chunk->faceConnectivity
+                                        : ALL_FACES_CONNECTED;
+            },
+            [&](int x, int y, int z) {
+                return inView(glm::vec3(x, y, z) * chunkWorldSize + gridOrigin);
+            },
+            [](int, int, int) {});
+    }
+    double ns = nsSince(start);
+    uint64_t allocationCalls = allocations.callCount();
+    uint64_t allocationBytes = allocations.byteCount();
+
+    // the occlusion buffer from the same cameras, the solid bottoms of the
+    // nearest chunks in view as occluders like ChunkManager does (without
+    // merging them)
+    OcclusionBuffer occlusion;
+    std::vector<Chunk *> inView;
+    std::vector<OcclusionBox> occluders;
+    long long occluded = 0;
+    double rasterNs = 0.0;
+    for (int f = 0; f < frusta; f++) {
+        Camera camera =
+            benchCamera(f, frusta, world.side * chunkWorldSize * 0.25f);
+        inView.clear();
+        for (Chunk *chunk : world.chunks) {
+            glm::vec3 center = chunk->chunkPosition + glm::vec3(chunkWorldSize / 2);
+            if (camera.frustum.CubeInFrustum(center, chunkWorldSize / 2,
+                                             chunkWorldSize / 2,
+                                             chunkWorldSize / 2)) {
+                inView.push_back(chunk);
+            }
+        }
+        auto distanceSq = [&](Chunk *chunk) {
+            glm::vec3 d = chunk->chunkPosition + glm::vec3(chunkWorldSize / 2) -
+                          camera.cameraPos;
+            return glm::dot(d, d);
+        };
+        std::sort(inView.begin(), inView.end(), [&](Chunk *a, Chunk *b) {
+            return distanceSq(a) < distanceSq(b);
+        });
+        occluders.clear();
+        for (Chunk *chunk : inView) {
+            if (chunk->solidLayers > 0 &&
+                (int)occluders.size() < ChunkManager::MAX_OCCLUDERS) {
+                glm::vec3 min = chunk->chunkPosition;
+                occluders.push_back(
+                    {min, min + glm::vec3(chunkWorldSize,
+                                          chunk->solidLayers * Block::BLOCK_RENDER_SIZE,
+                                          chunkWorldSize)});
+            }
+        }
+        glm::mat4 projection = glm::perspective(
+            glm::radians(camera.fov), (float)SCR_WIDTH / SCR_HEIGHT, camera.zNear,
+            camera.zFar);
+        glm::mat4 view = glm::lookAt(camera.cameraPos,
+                                     camera.cameraPos + camera.cameraFront,
+                                     camera.cameraUp);
+
+        BenchClock::time_point rasterStart = BenchClock::now();
+        occlusion.render(occluders, projection * view, camera.cameraPos,
+                         camera.zNear);
+        rasterNs += nsSince(rasterStart);
+        for (Chunk *chunk : inView) {
+            occluded += occlusion.isOccluded(
+                {chunk->chunkPosition,
+                 chunk->chunkPosition + glm::vec3(chunkWorldSize)});
+        }
+    }
+
+    BenchResult result = {"cull", {}};
+    result.add("ns_per_chunk", ns / ((double)frusta * world.chunks.size()));
+    result.add("ns_per_frustum", ns / frusta);
+    result.add("in_frustum_per_frame", (double)inFrustum / frusta);
+    result.add("reachable_per_frame", (double)reachable / frusta);
+    result.add("occlusion_render_us", rasterNs / frusta / 1e3);
+    result.add("occluded_per_frame", (double)occluded / frusta);
+    result.add("allocations", (double)allocationCalls);
+    result.add("allocated_bytes", (double)allocationBytes);
+    return result;
+}
+
+static BenchResult benchEcs(int entityCount, int steps) {
+    // MAX_ENTITIES is a hard limit of the entity manager
+    entityCount = std::min(entityCount, (int)MAX_ENTITIES);
+
+    AllocationScope setupAllocations;
+    gCoordinator.Init(nullptr);
+    gCoordinator.RegisterComponent<Gravity>();
+    gCoordinator.RegisterComponent<RigidBody>();
+    gCoordinator.RegisterComponent<Transform>();
+    auto physicsSystem = gCoordinator.RegisterSystem<PhysicsSystem>();
+    Signature signature;
+    signature.set(gCoordinator.GetComponentType<Gravity>());
+    signature.set(gCoordinator.GetComponentType<RigidBody>());
+    signature.set(gCoordinator.GetComponentType<Transform>());
+    gCoordinator.SetSystemSignature<PhysicsSystem>(signature);
+
+    BenchClock::time_point start = BenchClock::now();
+    std::vector<Entity> entities(entityCount);
+    for (int i = 0; i < entityCount; i++) {
+        float f = (float)i;
+        entities[i] = gCoordinator.CreateEntity();
+        gCoordinator.AddComponent(entities[i],
+                                  Gravity{glm::vec3(0.0f, -0.05f, 0.0f)});
+        gCoordinator.AddComponent(
+            entities[i],
+            RigidBody{glm::vec3(std::sin(f), 0.0f, std::cos(f)), glm::vec3(0.0f)});
+        gCoordinator.AddComponent(
+            entities[i], Transform{.position = glm::vec3(f, 10.0f, -f),
+                                   .rotation = glm::vec3(0.0f, 0.0f, 0.0f),
+                                   .scale = glm::vec3(1.0f)});
+    }
+    double createNs = nsSince(start);
+    uint64_t setupCalls = setupAllocations.callCount();
+
+    AllocationScope stepAllocations;
+    start = BenchClock::now();
+    for (int step = 0; step < steps; step++) {
+        physicsSystem->Update(1.0f / 60.0f);
+    }
+    double stepNs = nsSince(start);
+    uint64_t stepCalls = stepAllocations.callCount();
+
+    start = BenchClock::now();
+    for (Entity entity : entities) {
+        gCoordinator.DestroyEntity(entity);
+    }
+    double destroyNs = nsSince(start);
+
+    BenchResult result = {"ecs", {}};
+    result.add("entities", entityCount);
+    result.add("ns_per_entity_step", stepNs / ((double)entityCount * steps));
+    result.add("ns_per_entity_create", createNs / entityCount);
+    result.add("ns_per_entity_destroy", destroyNs / entityCount);
+    result.add("setup_allocations", (double)setupCalls);
+    result.add("step_allocations", (double)stepCalls);
+    return result;
+}
+
+// one 16x16 (2d) or 16^3 (3d) grid per chunk, the way the generators ask
+static BenchResult benchNoise(bool threeD, int chunkCount, int seed) {
+    constexpr int size = Chunk::CHUNK_SIZE;
+    const float step = 0.05f;
+    int perGrid = threeD ? size * size * size : size * size;
+    std::vector<float> reference(perGrid), batch(perGrid);
+    auto origin = [&](int i, int axis) {
+        // spread out, negative too, so cells and the 256 wrap get crossed
+        int c = (i * (axis == 0 ? 7 : axis == 1 ? 3 : 13)) % 97 - 48;
+        return c * size * step;
+    };
+
+    double stbNs = 0.0, batchNs = 0.0, maxError = 0.0, sink = 0.0;
+    for (int i = 0; i < chunkCount; i++) {
+        float x0 = origin(i, 0), y0 = threeD ? origin(i, 1) : 0.0f,
+              z0 = origin(i, 2);
+        int countY = threeD ? size : 1;
+
+        BenchClock::time_point start = BenchClock::now();
+        for (int z = 0; z < size; z++) {
+            for (int y = 0; y < countY; y++) {
+                for (int x = 0; x < size; x++) {
+                    reference[x + (y + z * countY) * size] = stb_perlin_noise3_seed(
+                        x0 + x * step, y0 + y * step, z0 + z * step, 0, 0, 0, seed);
+                }
+            }
+        }
+        stbNs += nsSince(start);
+
+        start = BenchClock::now();
+        if (threeD) {
+            NoiseGrid3D(x0, y0, z0, step, size, size, size, seed, batch.data());
+        } else {
+            NoiseGrid2D(x0, z0, step, size, size, y0, seed, batch.data());
+        }
+        batchNs += nsSince(start);
+
+        for (int s = 0; s < perGrid; s++) {
+            maxError = std::max(maxError, (double)std::fabs(reference[s] - batch[s]));
+            sink += batch[s];
+        }
+    }
+
+    double samples = (double)chunkCount * perGrid;
+    BenchResult result = {threeD ? "noise.3d" : "noise.2d", {}};
+    result.add("lanes", NOISE_LANES);
+    result.add("stb_msamples_per_sec", samples / stbNs * 1e3);
+    result.add("batch_msamples_per_sec", samples / batchNs * 1e3);
+    result.add("speedup", stbNs / batchNs);
+    result.add("checksum", sink);
+    result.add("max_abs_error", maxError);
+    return result;
+}
+
+// Decorations.h writes across chunk borders, the result mustn't depend on
+// which chunk got decorated first or on which thread
+static BenchResult benchDecorate(TerrainGenerator *generator, int chunkCount) {
+    BenchWorld inOrder(chunkCount);
+    for (Chunk *chunk : inOrder.chunks) {
+        chunk->generate(generator);
+    }
+    DecorationPass decorations(generator->getSeed(), -1);
+    BenchClock::time_point start = BenchClock::now();
+    for (Chunk *chunk : inOrder.chunks) {
+        decorations.decorate(chunk);
+    }
+    double ns = nsSince(start);
+
+    BenchWorld shuffled(chunkCount);
+    DecorationPass shuffledDecorations(generator->getSeed(), -1);
+    int threadCount = std::max(2u, std::thread::hardware_concurrency());
+    int count = (int)shuffled.chunks.size();
+    std::vector<std::future<void>> futures;
+    for (int t = 0; t < threadCount; t++) {
+        futures.push_back(std::async(std::launch::async, [&, t] {
+            for (int i = count - 1 - t; i >= 0; i -= threadCount) {
+                shuffled.chunks[i]->generate(generator);
+                shuffledDecorations.decorate(shuffled.chunks[i]);
+            }
+        }));
+    }
+    for (auto &future : futures) {
+        future.get();
+    }
+
+    int mismatched = 0;
+    for (int i = 0; i < count; i++) {
+        mismatched += hashBlocks(inOrder.chunks[i]) != hashBlocks(shuffled.chunks[i]);
+    }
+
+    BenchResult result = {"decorate", {}};
+    result.add("ns_per_chunk", ns / count);
+    result.add("features_per_chunk", (double)decorations.featuresPlaced.load() / count);
+    result.add("pending_writes", (double)decorations.pendingWrites.load());
+    result.add("direct_writes", (double)decorations.directWrites.load());
+    result.add("mismatched_chunks", mismatched);
+    return result;
+}
+
+// region files round trip, see WorldStorage.h
+static BenchResult benchStorage(const char *name, TerrainGenerator *generator,
+                                int chunkCount) {
+    BenchWorld world(chunkCount);
+    DecorationPass decorations(generator->getSeed(), -1);
+    for (Chunk *chunk : world.chunks) {
+        chunk->generate(generator);
+        decorations.decorate(chunk);
+    }
+    size_t count = world.chunks.size();
+    double blockMb = count * sizeof(Chunk::blocks) / (1024.0 * 1024.0);
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() /
+                                      (std::string("voxel-bench-") + name);
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+
+    double saveNs, loadNs;
+    uint64_t bytesWritten, fileBytes = 0;
+    int mismatched = 0;
+    {
+        WorldStorage storage(directory.string());
+        BenchClock::time_point start = BenchClock::now();
+        for (Chunk *chunk : world.chunks) {
+            mismatched += !chunk->saveTo(storage);
+        }
+        saveNs = nsSince(start);
+        bytesWritten = storage.bytesWritten.load();
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        fileBytes += entry.file_size();
+    }
+    {
+        BenchWorld loaded(chunkCount);
+        WorldStorage storage(directory.string());
+        BenchClock::time_point start = BenchClock::now();
+        for (Chunk *chunk : loaded.chunks) {
+            mismatched += !chunk->loadFrom(storage);
+        }
+        loadNs = nsSince(start);
+        for (size_t i = 0; i < count; i++) {
+            mismatched += hashBlocks(loaded.chunks[i]) != hashBlocks(world.chunks[i]);
+        }
+    }
+    std::filesystem::remove_all(directory, error);
+
+    BenchResult result = {std::string("storage.") + name, {}};
+    result.add("save_chunks_per_sec", count / saveNs * 1e9);
+    result.add("load_chunks_per_sec", count / loadNs * 1e9);
+    result.add("save_block_mb_per_sec", blockMb / saveNs * 1e9);
+    result.add("load_block_mb_per_sec", blockMb / loadNs * 1e9);
+    result.add("payload_bytes_per_chunk", (double)bytesWritten / count);
+    result.add("file_bytes", (double)fileBytes);
+    result.add("mismatched_chunks", mismatched);
+    return result;
+}
+
+// the io thread: queueing, coalescing, reads from the queue and the disk
+static BenchResult benchIo(TerrainGenerator *generator, int chunkCount) {
+    BenchWorld world(chunkCount);
+    DecorationPass decorations(generator->getSeed(), -1);
+    for (Chunk *chunk : world.chunks) {
+        chunk->generate(generator);
+        decorations.decorate(chunk);
+    }
+    size_t count = world.chunks.size();
+
+    std::filesystem::path directory =
+        std::filesystem::temp_directory_path() / "voxel-bench-io";
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+
+    int mismatched = 0;
+    auto loadAll = [&](ChunkIO &io, double &ns) {
+        BenchWorld loaded(chunkCount);
+        std::vector<ChunkIO::LoadRequest> requests;
+        for (Chunk *chunk : loaded.chunks) {
+            requests.push_back({chunk->storageCoords(), chunk->blocks});
+        }
+        BenchClock::time_point start = BenchClock::now();
+        io.load(requests);
+        ns = nsSince(start);
+        for (size_t i = 0; i < count; i++) {
+            mismatched += !requests[i].found ||
+                          hashBlocks(loaded.chunks[i]) != hashBlocks(world.chunks[i]);
+        }
+    };
+
+    double saveNs, flushNs, queuedLoadNs, loadNs;
+    uint64_t coalesced, written;
+    bool uring;
+    {
+        WorldStorage storage(directory.string());
+        // no timed flushes, only the one below
+        ChunkIO io(&storage, Chunk::CHUNK_SIZE_CUBED, std::chrono::minutes(10));
+        uring = std::strcmp(io.backend(), "io_uring") == 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (Chunk *chunk : world.chunks) {
+            io.save(chunk->storageCoords(), chunk->blocks);
+        }
+        saveNs = nsSince(start);
+        for (Chunk *chunk : world.chunks) {
+            io.save(chunk->storageCoords(), chunk->blocks);
+        }
+        coalesced = io.coalescedSaves.load();
+        loadAll(io, queuedLoadNs);
+
+        start = BenchClock::now();
+        io.flush();
+        flushNs = nsSince(start);
+        written = io.chunksWritten.load();
+    }
+    {
+        WorldStorage storage(directory.string());
+        ChunkIO io(&storage, Chunk::CHUNK_SIZE_CUBED);
+        loadAll(io, loadNs);
+    }
+    std::filesystem::remove_all(directory, error);
+    mismatched += written != count;
+
+    BenchResult result = {"io", {}};
+    result.add("io_uring", uring);
+    result.add("save_ns_per_chunk", saveNs / count);
+    result.add("coalesced_saves", (double)coalesced);
+    result.add("queued_load_chunks_per_sec", count / queuedLoadNs * 1e9);
+    result.add("flush_chunks_per_sec", count / flushNs * 1e9);
+    result.add("load_chunks_per_sec", count / loadNs * 1e9);
+    result.add("mismatched_chunks", mismatched);
+    return result;
+}
+
+// startup streaming of the engine's whole world (ChunkManager's
+// pregenerateChunks) from where the engine's camera starts, uploads off.
+// Then every chunk is meshed again from its final blocks, a mesh the stream
+// built before its blocks were done fails the run
+static BenchResult benchStartup(TerrainGenerator *generator) {
+    ChunkManager manager(4, 3, nullptr, generator);
+    manager.uploadMeshes = false;
+    glm::vec3 cameraPosition = Camera().cameraPos;
+
+    BenchClock::time_point start = BenchClock::now();
+    manager.pregenerateChunks(cameraPosition);
+    double createNs = nsSince(start);
+    manager.waitForChunksAround(cameraPosition);
+    double firstFrameNs = nsSince(start);
+    manager.finishStreaming();
+    double fullWorldNs = nsSince(start);
+
+    int mismatched = manager.streamedChunks != manager.streamTotal;
+    for (Chunk *chunk : manager.chunkVisibilityList) {
+        uint64_t streamed = hashMeshes(chunk);
+        UnloadChunkMesh(chunk->mesh);
+        UnloadChunkMesh(chunk->translucentMesh);
+        chunk->buildMesh(manager.GetNeighbourhood(chunk));
+        mismatched += hashMeshes(chunk) != streamed;
+    }
+    size_t count = manager.chunkVisibilityList.size();
+    for (Chunk *&chunk : manager.chunks) {
+        if (chunk != nullptr) {
+            chunk->unload();
+            delete chunk;
+            chunk = nullptr;
+        }
+    }
+
+    BenchResult result = {"startup", {}};
+    result.add("threads", (double)std::max(1u, std::thread::hardware_concurrency()));
+    result.add("chunks", (double)count);
+    result.add("create_ms", createNs / 1e6);
+    result.add("time_to_first_frame_ms", firstFrameNs / 1e6);
+    result.add("time_to_full_world_ms", fullWorldNs / 1e6);
+    result.add("chunks_per_sec", count / fullWorldNs * 1e9);
+    result.add("mismatched_meshes", mismatched);
+    return result;
+}
+
+// generation must not depend on the thread or the order chunks are made in,
+// see Random.h
+static BenchResult benchDeterminism(const char *name,
+                                    TerrainGenerator *generator,
+                                    int chunkCount) {
+    constexpr int size = Chunk::CHUNK_SIZE;
+    constexpr int cubed = Chunk::CHUNK_SIZE_CUBED;
+    int side = std::max(1, (int)std::lround(std::cbrt((double)chunkCount)));
+    chunkCount = side * side * side;
+    auto chunkPosition = [&](int i) {
+        return glm::vec3((i % side - side / 2) * size,
+                         (i / side % side - side) * size,
+                         (i / (side * side) - side / 2) * size);
+    };
+
+    std::vector<Block> inOrder(chunkCount * cubed);
+    for (int i = 0; i < chunkCount; i++) {
+        generator->generateChunk(chunkPosition(i), &inOrder[i * cubed]);
+    }
+
+    // every thread takes every threadCount-th chunk from the back
+    int threadCount = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<Block> shuffled(chunkCount * cubed);
+    std::vector<std::future<void>> futures;
+    for (int t = 0; t < threadCount; t++) {
+        futures.push_back(std::async(std::launch::async, [&, t] {
+            for (int i = chunkCount - 1 - t; i >= 0; i -= threadCount) {
+                // and through the columnBounds shortcut, which has to
+                // come out the same as generateChunk
+                if (!generator->generateFromBounds(chunkPosition(i),
+                                                   &shuffled[i * cubed])) {
+                    generator->generateChunk(chunkPosition(i), &shuffled[i * cubed]);
+                }
+            }
+        }));
+    }
+    for (auto &future : futures) {
+        future.get();
+    }
+
+    int mismatched = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        for (int b = 0; b < cubed; b++) {
+            const Block &x = inOrder[i * cubed + b];
+            const Block &y = shuffled[i * cubed + b];
+            if (x.isActive != y.isActive ||
+                (x.isActive && x.blockType != y.blockType)) {
+                mismatched++;
+                break;
+            }
+        }
+    }
+
+    BenchResult result = {std::string("determinism.") + name, {}};
+    result.add("chunks", chunkCount);
+    result.add("threads", threadCount);
+    result.add("mismatched_chunks", mismatched);
+    return result;
+}
+
+static bool writeReport(const std::string &path, const BenchOptions &options,
+                        const std::vector<BenchResult> &results,
+                        size_t peakRss) {
+    FILE *file = std::fopen(path.c_str(), "w");
+    if (file == NULL) {
+        std::printf("bench: can't write report to %s\n", path.c_str());
+        return false;
+    }
+    std::fprintf(file, "{\n");
+    std::fprintf(file, "  \"seed\": %d,\n", options.seed);
+    std::fprintf(file, "  \"workloads\": {\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        std::fprintf(file, "    \"%s\": {", results[i].name.c_str());
+        for (size_t m = 0; m < results[i].metrics.size(); m++) {
+            std::fprintf(file, "%s\"%s\": %.4f", m > 0 ? ", " : "",
+                         results[i].metrics[m].first.c_str(),
+                         results[i].metrics[m].second);
+        }
+        std::fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "  },\n");
+    std::fprintf(file, "  \"total_allocations\": %llu,\n",
+                 (unsigned long long)gAllocCalls.load());
+    std::fprintf(file, "  \"peak_rss_bytes\": %zu,\n", peakRss);
+    std::fprintf(file, "  \"memory_peak_bytes\": {\n");
+    for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+        std::fprintf(file, "    \"%s\": %lld%s\n", MEMORY_CATEGORY_KEYS[i],
+                     (long long)MemoryStats::peakBytes[i].load(),
+                     i + 1 < NUM_MEMORY_CATEGORIES ? "," : "");
+    }
+    std::fprintf(file, "  }\n");
+    std::fprintf(file, "}\n");
+    std::fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!ParseBenchOptions(argc, argv, options)) {
+        return -1;
+    }
+
+    // two of each, the second for the batch pass of gen.*
+    struct NamedGenerator {
+        const char *name;
+        TerrainGenerator *generator;
+        TerrainGenerator *batchGenerator;
+    };
+    auto make = [&](auto create, const char *name) {
+        return NamedGenerator{name, create(), create()};
+    };
+    int seed = options.seed;
+    NamedGenerator generators[] = {
+        make([&] { return new TerrainGenerator(Chunk::CHUNK_SIZE, seed); }, "default"),
+        make([&] { return new PlainsTerrainGenerator(Chunk::CHUNK_SIZE, seed); }, "plains"),
+        make([&] { return new HillsTerrainGenerator(Chunk::CHUNK_SIZE, seed); }, "hills"),
+        make([&] { return new PlatformTerrainGenerator(Chunk::CHUNK_SIZE, seed); },
+             "platform"),
+        make([&] { return new CavesTerrainGenerator(Chunk::CHUNK_SIZE, seed); }, "caves"),
+        make([&] { return new CavesTerrainGenerator(Chunk::CHUNK_SIZE, seed, 1); },
+             "caves_per_voxel"),
+        make([&] { return new BiomeTerrainGenerator(Chunk::CHUNK_SIZE, seed); }, "biomes"),
+    };
+    BiomeTerrainGenerator *biomes =
+        (BiomeTerrainGenerator *)generators[std::size(generators) - 1].generator;
+
+    std::vector<BenchResult> results;
+    size_t peakRss = 0;
+    auto record = [&](BenchResult result) {
+        peakRss = std::max(peakRss, getMemoryUsage());
+        std::printf("%-16s", result.name.c_str());
+        for (auto &metric : result.metrics) {
+            std::printf("  %s %.1f", metric.first.c_str(), metric.second);
+        }
+        std::printf("\n");
+        results.push_back(std::move(result));
+    };
+
+    bool batchMatches = true;
+    bool meshCacheMatches = true;
+    for (NamedGenerator &named : generators) {
+        BenchWorld world(options.chunks);
+        BenchResult generate =
+            benchGenerate(named.name, named.generator, named.batchGenerator, world);
+        batchMatches = batchMatches && generate.metrics.back().second == 0.0;
+        record(std::move(generate));
+        record(benchMesh(named.name, world));
+        if (std::strcmp(named.name, "hills") == 0 ||
+            std::strcmp(named.name, "default") == 0) {
+            BenchResult result = benchMeshCache(named.name, world);
+            meshCacheMatches = meshCacheMatches && result.metrics.back().second == 0.0;
+            record(std::move(result));
+        }
+        if (std::strcmp(named.name, "hills") == 0) {
+            record(benchCull(world, options.frusta));
+        }
+    }
+
+    if (!meshCacheMatches) {
+        std::printf("bench: cached meshes differ from built ones, see meshcache.*\n");
+    }
+
+    // blending is the slow path, it should stay at the borders
+    BenchResult biomeResult = {"biomes", {}};
+    biomeResult.add("interior_chunks", (double)biomes->interiorChunks.load());
+    biomeResult.add("border_chunks", (double)biomes->borderChunks.load());
+    record(std::move(biomeResult));
+
+    bool storageMatches = true;
+    for (NamedGenerator &named : generators) {
+        if (std::strcmp(named.name, "hills") == 0 ||
+            std::strcmp(named.name, "default") == 0) {
+            BenchResult result = benchStorage(named.name, named.generator, options.chunks);
+            storageMatches = storageMatches && result.metrics.back().second == 0.0;
+            record(std::move(result));
+        }
+    }
+    for (NamedGenerator &named : generators) {
+        if (std::strcmp(named.name, "hills") == 0) {
+            BenchResult result = benchIo(named.generator, options.chunks);
+            storageMatches = storageMatches && result.metrics.back().second == 0.0;
+            record(std::move(result));
+        }
+    }
+    if (!storageMatches) {
+        std::printf("bench: chunks don't load back as saved, see storage.* and io\n");
+    }
+
+    bool startupMatches = true;
+    for (NamedGenerator &named : generators) {
+        if (std::strcmp(named.name, "hills") == 0) {
+            BenchResult result = benchStartup(named.generator);
+            startupMatches = result.metrics.back().second == 0.0;
+            record(std::move(result));
+        }
+    }
+    if (!startupMatches) {
+        std::printf("bench: streamed meshes aren't the ones the final blocks give, "
+                    "see startup\n");
+    }
+
+    record(benchEcs(options.entities, options.steps));
+
+    bool noiseMatches = true;
+    for (bool threeD : {false, true}) {
+        BenchResult result = benchNoise(threeD, options.chunks, options.seed);
+        noiseMatches = noiseMatches && result.metrics.back().second <= NOISE_TOLERANCE;
+        record(std::move(result));
+    }
+    if (!noiseMatches) {
+        std::printf("bench: batch noise is off from stb_perlin, see noise.*\n");
+    }
+
+    bool deterministic = true;
+    for (NamedGenerator &named : generators) {
+        if (std::strcmp(named.name, "hills") == 0) {
+            BenchResult result = benchDecorate(named.generator, options.chunks);
+            deterministic = result.metrics.back().second == 0.0;
+            record(std::move(result));
+        }
+    }
+    for (NamedGenerator &named : generators) {
+        BenchResult result =
+            benchDeterminism(named.name, named.generator, std::min(options.chunks, 512));
+        deterministic = deterministic && result.metrics.back().second == 0.0;
+        record(std::move(result));
+    }
+    if (!deterministic) {
+        std::printf("bench: generation differs between runs, see determinism.*\n");
+    }
+    bool written = writeReport(options.reportPath, options, results, peakRss);
+    if (!batchMatches) {
+        std::printf("bench: generateChunks differs from generateChunk, see gen.*\n");
+    }
+    return written && deterministic && noiseMatches && batchMatches && storageMatches &&
+                   meshCacheMatches && startupMatches
+               ? 0
+               : -1;
+}
@@ -17,7 +17,18 @@
 #include <iostream>
 #include "utils.h"
 
+#include "CameraPath.h"
+#include "FrameStats.h"
+#include "Headless.h"
+#include "Horizon.h"
+#include "Options.h"
+#include "ProfilerWindow.h"
 #include "Texture.h"
+#include "ChunkIO.h"
+#include "MeshCache.h"
+#include "WorldStorage.h"
+#include "terrain/Biomes.h"
+#include "terrain/Caves.h"
 #include "terrain/Plains.h"
 #include "terrain/Hills.h"
 #include "terrain/Platform.h"
@@ -29,6 +40,10 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window, bool *cursorOn);
 int calculateFPS(float deltaTime);
 float calculateMemUsage();
+float calculateWriteRate(uint64_t bytesWritten);
+int runHeadless(const AppOptions &options, Horizon *horizon,
+                std::shared_ptr<PhysicsSystem> physicsSystem,
+                double startupMs, double firstFrameMs, double fullWorldMs);
 void renderText(Shader &shader, std::string text, float x, float y, float scale,
                 glm::vec3 color);
 
@@ -44,69 +59,88 @@ ChunkManager *chunkManager;
 // Global coordinator
 Coordinator gCoordinator;
 
-const int FPS_HISTORY_CAP = 5000;
 const int MEM_HISTORY_CAP = 5000;
-std::vector<float> fpsHistory;
 std::vector<float> memHistory;
 
+// every frame's time, see FrameStats.h
+FrameStats frameStats;
 
 
 
 
 
-int main() {
-    // glfw: initialize and configure
+
+int main(int argc, char **argv) {
+    AppOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        return -1;
+    }
+    auto startupBegin = std::chrono::steady_clock::now();
+    Profiler::get().setThreadName("main");
+
+    // headless: offscreen context, no imgui or input, see Headless.h
     // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow *window = NULL;
+    HeadlessContext headlessContext;
+    bool cursorOn = false;
+    if (options.headless) {
+        if (!headlessContext.create(SCR_WIDTH, SCR_HEIGHT)) {
+            std::cout << "Failed to create headless GL context" << std::endl;
+            return -1;
+        }
+    } else {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow *window =
-        glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "woksol", NULL, NULL);
-    if (window == NULL) {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        // glfw window creation
+        // --------------------
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "woksol", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSwapInterval(0);
+
+        // imgui!!!
+        // Setup Dear ImGui context
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO &io = ImGui::GetIO();
+        io.ConfigFlags |=
+            ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
+        io.ConfigFlags |=
+            ImGuiConfigFlags_NavEnableGamepad; // Enable Gamepad Controls
+        // io.ConfigFlags |= ImGuiConfigFlags_DockingEnable; // IF using Docking
+        // Branch
+
+        // Setup Platform/Renderer backends
+        ImGui_ImplGlfw_InitForOpenGL(
+            window, true); // Second param install_callback=true will install GLFW
+                           // callbacks and chain to existing ones.
+        ImGui_ImplOpenGL3_Init(nullptr);
+
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     }
-    glfwMakeContextCurrent(window);
-    glfwSwapInterval(0);
-
-    // imgui!!!
-    // Setup Dear ImGui context
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO &io = ImGui::GetIO();
-    io.ConfigFlags |=
-        ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
-    io.ConfigFlags |=
-        ImGuiConfigFlags_NavEnableGamepad; // Enable Gamepad Controls
-    // io.ConfigFlags |= ImGuiConfigFlags_DockingEnable; // IF using Docking
-    // Branch
-
-    // Setup Platform/Renderer backends
-    ImGui_ImplGlfw_InitForOpenGL(
-        window, true); // Second param install_callback=true will install GLFW
-                       // callbacks and chain to existing ones.
-    ImGui_ImplOpenGL3_Init(nullptr);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-
-    // tell GLFW to capture our mouse
-    bool cursorOn = false;
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(options.headless ? headlessContext.loader()
+                                           : (GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
@@ -114,7 +148,8 @@ int main() {
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
+    // blending is only enabled for the translucent pass, see
+    // ChunkManager::render
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // build and compile shader programs
@@ -123,6 +158,8 @@ int main() {
         new Shader("src/shaders/terrain.vert", "src/shaders/terrain.frag");
     Shader *defaultShader =
         new Shader("src/shaders/shader.vert", "src/shaders/shader.frag");
+    Shader *horizonShader =
+        new Shader("src/shaders/horizon.vert", "src/shaders/horizon.frag");
 
     // glm::vec3 pos = glm::vec3(0, 0, 0);
     // Chunk chunk = Chunk(pos, ourShader);
@@ -137,6 +174,7 @@ int main() {
     ourShader->setInt("texture1", 0);   // set texture1 in shader to binded texture #0
     ourShader->setFloat("texWidth", (1.0f / (float) blockTextures.atlasCols));
     ourShader->setFloat("texHeight", (1.0f / (float) blockTextures.atlasRows));
+    ourShader->setFloat("blockRenderSize", (float) Block::BLOCK_RENDER_SIZE);
 
 
     // optional: back face culling
@@ -154,13 +192,53 @@ int main() {
 
     // Use custom terrain generator
     // TerrainGenerator * terrainGenerator = new HillsTerrainGenerator(Chunk::CHUNK_SIZE, 1337);
+    // TerrainGenerator * terrainGenerator = new CavesTerrainGenerator(Chunk::CHUNK_SIZE, 1337);
+    // TerrainGenerator * terrainGenerator = new BiomeTerrainGenerator(Chunk::CHUNK_SIZE, 1337);
 
     // initialize coordinator
     chunkManager = new ChunkManager(4, 3, ourShader, terrainGenerator);
     gCoordinator.Init(chunkManager);
 
-    // generate terrain
-    gCoordinator.mChunkManager->pregenerateChunks();
+    // --world: chunks saved there are loaded rather than generated, and
+    // everything generated is saved there on exit. Disk access goes
+    // through the io thread
+    WorldStorage *worldStorage = nullptr;
+    ChunkIO *chunkIO = nullptr;
+    if (!options.worldPath.empty()) {
+        worldStorage = new WorldStorage(options.worldPath);
+        chunkIO = new ChunkIO(worldStorage, Chunk::CHUNK_SIZE_CUBED);
+        chunkManager->io = chunkIO;
+    }
+
+    // --mesh-cache: chunks that are the same as when their mesh was cached
+    // upload it as it is instead of meshing
+    MeshCache *meshCache = nullptr;
+    if (!options.meshCachePath.empty()) {
+        meshCache = new MeshCache(options.meshCachePath,
+                                  (uint64_t)options.meshCacheMb << 20);
+        chunkManager->meshCache = meshCache;
+    }
+
+    // far terrain past the render distance
+    Horizon *horizon = new Horizon(terrainGenerator, horizonShader);
+
+    // headless runs stream the world in from where their camera path starts
+    if (options.headless) {
+        std::vector<CameraSample> replay;
+        if (options.replayPath.empty()) {
+            ScriptedCameraPath(0, options.frames, gCoordinator.mCamera);
+        } else if (LoadCameraPath(options.replayPath, replay) && !replay.empty()) {
+            ApplyCameraSample(replay[0], gCoordinator.mCamera);
+        }
+    }
+
+    // generate terrain, on worker threads from the camera outwards
+    gCoordinator.mChunkManager->pregenerateChunks(gCoordinator.mCamera.cameraPos);
+    auto msSinceStartup = [&] {
+        return std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - startupBegin)
+            .count();
+    };
 
     gCoordinator.RegisterComponent<Gravity>();
     gCoordinator.RegisterComponent<RigidBody>();
@@ -192,6 +270,33 @@ int main() {
 
     auto player = entities[0];
 
+    if (options.headless) {
+        double startupMs = msSinceStartup();
+        // frames only start once the whole world is there, so every run
+        // does the same work
+        chunkManager->waitForChunksAround(gCoordinator.mCamera.cameraPos);
+        double firstFrameMs = msSinceStartup();
+        chunkManager->finishStreaming();
+        double fullWorldMs = msSinceStartup();
+        int result = runHeadless(options, horizon, physicsSystem, startupMs,
+                                 firstFrameMs, fullWorldMs);
+        chunkManager->saveChunks();
+        delete chunkIO;
+        chunkManager->meshCache = nullptr;
+        delete meshCache;
+        headlessContext.destroy();
+        return result;
+    }
+
+    // --record: the camera of every frame, written when the window closes
+    CameraRecorder recorder;
+
+    // the first frame waits for the chunks around the camera, the rest
+    // stream in while it runs
+    chunkManager->waitForChunksAround(gCoordinator.mCamera.cameraPos);
+    double firstFrameMs = -1.0;
+    double fullWorldMs = -1.0;
+
     // render loop
     // -----------
 
@@ -200,7 +305,16 @@ int main() {
         // --------------------
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
+        // the first frame's time is all of startup
+        if (lastFrame > 0.0f) {
+            frameStats.record(deltaTime * 1000.0);
+        }
         lastFrame = currentFrame;
+        if (fullWorldMs < 0.0 && !chunkManager->isStreaming()) {
+            fullWorldMs = msSinceStartup();
+            std::cout << "startup: full world after " << fullWorldMs << " ms"
+                      << std::endl;
+        }
 
         physicsSystem->Update(deltaTime);
 
@@ -218,12 +332,19 @@ int main() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // update
+        if (!options.recordPath.empty()) {
+            recorder.record(gCoordinator.mCamera);
+        }
         gCoordinator.mChunkManager->update(deltaTime, gCoordinator.mCamera);
         // get player deets
         RigidBody playerRB = gCoordinator.GetComponent<RigidBody>(player);
         Transform playerTrans = gCoordinator.GetComponent<Transform>(player);
 
         // render
+        horizon->update(gCoordinator.mCamera.cameraPos);
+        horizon->render(gCoordinator.mCamera,
+                        gCoordinator.mChunkManager->chunkRenderDistance *
+                            Chunk::CHUNK_SIZE * Block::BLOCK_RENDER_SIZE);
         gCoordinator.mChunkManager->render(gCoordinator.mCamera);
         
         // TODO: render the "player" entity
@@ -249,7 +370,92 @@ int main() {
         ImGui::Begin("Stats", &active, statsFlags);
         ImGui::Text("%s", fpsStr);
         ImGui::Text("%s", memStr);
+        if (!options.recordPath.empty()) {
+            ImGui::Text("recording camera: %zu frames", recorder.samples.size());
+        }
+        if (ImGui::BeginTable("##memory", 4,
+                              ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg |
+                                  ImGuiTableFlags_SizingFixedFit)) {
+            ImGui::TableSetupColumn("memory");
+            ImGui::TableSetupColumn("MB");
+            ImGui::TableSetupColumn("peak MB");
+            ImGui::TableSetupColumn("allocs");
+            ImGui::TableHeadersRow();
+            for (int i = 0; i < NUM_MEMORY_CATEGORIES; i++) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted(MEMORY_CATEGORY_NAMES[i]);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", MemoryStats::bytes[i].load() / 1e6);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2f", MemoryStats::peakBytes[i].load() / 1e6);
+                ImGui::TableNextColumn();
+                ImGui::Text("%lld", (long long)MemoryStats::allocations[i].load());
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted("tracked total");
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", MemoryStats::total() / 1e6);
+            ImGui::EndTable();
+        }
+        ImGui::Separator();
+        ImGui::Text("frame ms  p50 %.2f  p95 %.2f  p99 %.2f  max %.2f",
+                    frameStats.percentile(0.50), frameStats.percentile(0.95),
+                    frameStats.percentile(0.99), frameStats.maxMs);
+        ImGui::Text("over 16.6ms: %llu  over 33.3ms: %llu  (%llu frames)",
+                    (unsigned long long)frameStats.slowFrames,
+                    (unsigned long long)frameStats.verySlowFrames,
+                    (unsigned long long)frameStats.frames);
+        ImGui::PlotLines("##frameTimes", frameStats.history,
+                         FrameStats::HISTORY, frameStats.historyOffset,
+                         "frame ms", 0.0f, 50.0f, ImVec2(300.0f, 60.0f));
+        if (ImGui::Button("reset stats")) {
+            frameStats.reset();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("export csv")) {
+            frameStats.exportCsv("frame_stats.csv");
+        }
         ImGui::Separator();
+        ImGui::Text("chunks drawn: %d",
+                    (int)gCoordinator.mChunkManager->chunkRenderList.size());
+        ImGui::Text("cave culled: %d",
+                    gCoordinator.mChunkManager->caveCulledCount);
+        ImGui::Text("generation skipped: %llu empty, %llu solid",
+                    (unsigned long long)terrainGenerator->skippedEmpty.load(),
+                    (unsigned long long)terrainGenerator->skippedSolid.load());
+        if (chunkIO != nullptr) {
+            ImGui::Text("world: %llu chunks loaded (%.1f KB)",
+                        (unsigned long long)chunkIO->chunksRead.load(),
+                        chunkIO->bytesRead.load() / 1024.0);
+            ImGui::Text("io (%s): queue %zu, %.1f KB/s written", chunkIO->backend(),
+                        chunkIO->queueDepth(),
+                        calculateWriteRate(chunkIO->bytesWritten.load()) / 1024.0f);
+        }
+        if (chunkManager->isStreaming()) {
+            ImGui::Text("streaming: %zu / %zu chunks", chunkManager->streamedChunks,
+                        chunkManager->streamTotal);
+        } else {
+            ImGui::Text("startup: first frame %.0f ms, full world %.0f ms",
+                        firstFrameMs, fullWorldMs);
+        }
+        if (meshCache != nullptr) {
+            ImGui::Text("mesh cache: %.0f%% hits (%llu / %llu), %.1f / %.0f MB",
+                        meshCache->hitRate() * 100.0,
+                        (unsigned long long)meshCache->hits.load(),
+                        (unsigned long long)(meshCache->hits.load() +
+                                             meshCache->misses.load()),
+                        meshCache->bytesUsed() / 1e6, meshCache->capacity() / 1e6);
+        }
+        ImGui::Text("occluded: %d / %d (%.0f%%)",
+                    gCoordinator.mChunkManager->occlusionCulledCount,
+                    gCoordinator.mChunkManager->occlusionTestedCount,
+                    gCoordinator.mChunkManager->occlusionTestedCount > 0
+                        ? 100.0f *
+                              gCoordinator.mChunkManager->occlusionCulledCount /
+                              gCoordinator.mChunkManager->occlusionTestedCount
+                        : 0.0f);
         // Ends the window
         ImGui::End();
 
@@ -325,6 +531,13 @@ int main() {
             // Text that appears in the window
             ImGui::Checkbox("generate chunks",
                             &gCoordinator.mChunkManager->genChunk);
+            ImGui::Checkbox("trees and boulders",
+                            &gCoordinator.mChunkManager->decorate);
+            ImGui::Checkbox("cave culling",
+                            &gCoordinator.mChunkManager->caveCulling);
+            ImGui::Checkbox("occlusion culling",
+                            &gCoordinator.mChunkManager->occlusionCulling);
+            ImGui::Checkbox("horizon", &horizon->enabled);
             ImGui::LabelText("##moveSpeedLabel", "Movement Speed");
             ImGui::SliderFloat("##moveSpeedSlider",
                                &gCoordinator.mCamera.cameraSpeedMultiplier,
@@ -337,7 +550,7 @@ int main() {
             ImGui::SliderInt(
                 "##renderDistanceSlider",
                 (int *)&(gCoordinator.mChunkManager->chunkRenderDistance), 1,
-                16);
+                64);
             ImGui::LabelText("##zFarLabel", "zFar");
             ImGui::SliderFloat("##zFarSlider", &gCoordinator.mCamera.zFar, 1.0f,
                                2000.0f);
@@ -349,12 +562,41 @@ int main() {
             ImGui::End();
         }
 
+        DrawProfilerWindow();
+        Profiler::get().endFrame();
+
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         // Swap buffers and poll IO events
         glfwSwapBuffers(window);
         glfwPollEvents();
+        if (firstFrameMs < 0.0) {
+            firstFrameMs = msSinceStartup();
+            std::cout << "startup: first frame after " << firstFrameMs << " ms"
+                      << std::endl;
+        }
+    }
+
+    chunkManager->saveChunks();
+    if (chunkIO != nullptr) {
+        std::cout << "world: " << chunkIO->chunksRead << " chunks loaded, "
+                  << chunkIO->chunksWritten << " saved to " << options.worldPath
+                  << std::endl;
+    }
+    // flushes whatever is still queued
+    delete chunkIO;
+    if (meshCache != nullptr) {
+        std::cout << "mesh cache: " << meshCache->hits << " hits, "
+                  << meshCache->misses << " misses, " << meshCache->entries()
+                  << " meshes in " << options.meshCachePath << std::endl;
+    }
+    chunkManager->meshCache = nullptr;
+    delete meshCache;
+
+    if (!options.recordPath.empty() && recorder.save(options.recordPath)) {
+        std::cout << "recorded " << recorder.samples.size()
+                  << " frames to " << options.recordPath << std::endl;
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
@@ -371,6 +613,113 @@ int main() {
     return 0;
 }
 
+// fixed number of frames along the scripted (or --replay) camera path,
+// rendered offscreen, then the report. Runs with a fixed timestep so every run
+// does the same work
+int runHeadless(const AppOptions &options, Horizon *horizon,
+                std::shared_ptr<PhysicsSystem> physicsSystem,
+                double startupMs, double firstFrameMs, double fullWorldMs) {
+    std::vector<CameraSample> replay;
+    int frames = options.frames;
+    if (!options.replayPath.empty()) {
+        if (!LoadCameraPath(options.replayPath, replay) || replay.empty()) {
+            return -1;
+        }
+        frames = (int)replay.size();
+    }
+
+    OffscreenTarget target;
+    if (!target.create(SCR_WIDTH, SCR_HEIGHT)) {
+        std::cout << "Failed to create offscreen framebuffer" << std::endl;
+        return -1;
+    }
+
+    constexpr float dt = 1.0f / 60.0f;
+    using clock = std::chrono::steady_clock;
+    auto msSince = [](clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start)
+            .count();
+    };
+
+    ChunkManager *manager = gCoordinator.mChunkManager;
+    HeadlessReport report;
+    report.startupMs = startupMs;
+    report.firstFrameMs = firstFrameMs;
+    report.fullWorldMs = fullWorldMs;
+    report.cameraPath =
+        options.replayPath.empty() ? "scripted" : options.replayPath;
+    for (int frame = 0; frame < frames; frame++) {
+        auto frameStart = clock::now();
+        if (replay.empty()) {
+            ScriptedCameraPath(frame, frames, gCoordinator.mCamera);
+        } else {
+            ApplyCameraSample(replay[frame], gCoordinator.mCamera);
+        }
+        physicsSystem->Update(dt);
+
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        auto start = clock::now();
+        manager->update(dt, gCoordinator.mCamera);
+        report.addStage("update", msSince(start));
+        for (int i = 0; i < ChunkManager::NUM_UPDATE_STAGES; i++) {
+            report.addStage(std::string("update.") +
+                                ChunkManager::UPDATE_STAGE_NAMES[i],
+                            manager->stageMs[i]);
+        }
+
+        // how far behind the chunk queues are after this frame's update
+        int unloaded = 0;
+        int unmeshed = 0;
+        for (Chunk *chunk : manager->chunkVisibilityList) {
+            unloaded += !chunk->isLoaded();
+            unmeshed += !chunk->isSetup();
+        }
+        report.addQueueDepth("unloaded", unloaded);
+        report.addQueueDepth("unmeshed", unmeshed);
+        report.addQueueDepth("rebuild", (int)manager->chunkRebuildList.size());
+
+        start = clock::now();
+        horizon->update(gCoordinator.mCamera.cameraPos);
+        horizon->render(gCoordinator.mCamera,
+                        manager->chunkRenderDistance * Chunk::CHUNK_SIZE *
+                            Block::BLOCK_RENDER_SIZE);
+        report.addStage("horizon", msSince(start));
+
+        start = clock::now();
+        manager->render(gCoordinator.mCamera);
+        report.addStage("render", msSince(start));
+
+        // wait for the GPU so the frame time includes its work
+        start = clock::now();
+        glFinish();
+        report.addStage("gpu_finish", msSince(start));
+
+        Profiler::get().endFrame();
+        report.frameMs.push_back(msSince(frameStart));
+        report.chunksDrawn += manager->chunkRenderList.size();
+        report.chunksCaveCulled += manager->caveCulledCount;
+        report.chunksOccluded += manager->occlusionCulledCount;
+        // statm once per simulated second, like the windowed overlay
+        if (frame % 60 == 0 || frame == frames - 1) {
+            report.peakMemory = std::max(report.peakMemory, getMemoryUsage());
+        }
+    }
+
+    target.destroy();
+    if (manager->meshCache != nullptr) {
+        report.meshCacheHits = manager->meshCache->hits;
+        report.meshCacheMisses = manager->meshCache->misses;
+    }
+    if (!report.write(options.reportPath)) {
+        return -1;
+    }
+    std::cout << "headless: " << frames << " frames, report written to "
+              << options.reportPath << std::endl;
+    return 0;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this
 // frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
@@ -466,11 +815,36 @@ int calculateFPS(float deltaTime) {
 }
 
 // Function to calculate and return the RAM usage as a string
+// reading statm opens and parses a file, so it's only done once a second and
+// the last value is returned in between
 float calculateMemUsage() {
-    float memUsage = (float)getMemoryUsage();
+    static double lastRead = -1.0;
+    static float memUsage = 0.0f;
+    double now = glfwGetTime();
+    if (lastRead < 0.0 || now - lastRead >= 1.0) {
+        memUsage = (float)getMemoryUsage();
+        lastRead = now;
+    }
     return memUsage;
 }
 
+// bytes written per second by the io thread, over the last second
+float calculateWriteRate(uint64_t bytesWritten) {
+    static double lastRead = -1.0;
+    static uint64_t lastBytes = 0;
+    static float rate = 0.0f;
+    double now = glfwGetTime();
+    if (lastRead < 0.0) {
+        lastRead = now;
+        lastBytes = bytesWritten;
+    } else if (now - lastRead >= 1.0) {
+        rate = (float)((bytesWritten - lastBytes) / (now - lastRead));
+        lastRead = now;
+        lastBytes = bytesWritten;
+    }
+    return rate;
+}
+
 // glfw: whenever the mouse moves, this callback is called
 // -------------------------------------------------------
 void mouse_callback(GLFWwindow *window, double xposIn, double yposIn) {
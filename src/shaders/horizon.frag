@@ -0,0 +1,30 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 worldPos;
+in vec4 color;
+
+uniform vec3 cameraPos;
+// chunks are drawn inside this distance
+uniform float innerRadius;
+// area covered by the next ring in: min x, min z, max x, max z
+uniform vec4 innerRect;
+// distance where the horizon fades into the clear colour
+uniform float fogEnd;
+
+const vec3 fogColor = vec3(0.2, 0.3, 0.3);
+
+void main()
+{
+    float dist = length(worldPos.xz - cameraPos.xz);
+    if (dist < innerRadius) {
+        discard;
+    }
+    if (worldPos.x > innerRect.x && worldPos.z > innerRect.y &&
+        worldPos.x < innerRect.z && worldPos.z < innerRect.w) {
+        discard;
+    }
+
+    float fog = smoothstep(innerRadius, fogEnd, dist);
+    FragColor = vec4(mix(color.rgb, fogColor, fog), 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec4 aColor;
+
+out vec3 worldPos;
+out vec4 color;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    worldPos = aPos;
+    color = aColor;
+    gl_Position = projection * view * vec4(aPos, 1.0);
+}
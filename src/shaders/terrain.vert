@@ -20,6 +20,9 @@ uniform mat4 projection;
 uniform float texWidth;
 uniform float texHeight;
 
+// world size of a block, vertex positions are in block corners
+uniform float blockRenderSize;
+
 // const vec3 colors[3] = vec3[](vec3(0.0, 0.0, 0.0), vec3(0.0, 0.5, 0.0), vec3(0.5, 0.5, 0.0));
 
 
@@ -33,32 +36,34 @@ const float brightnessArr[6] = float[6](
     0.60  // bottom
 );
 
+// baked ambient occlusion, 0 = corner surrounded by 3 blocks, 3 = open
+const float aoArr[4] = float[4](0.45, 0.65, 0.82, 1.0);
+
 
 void main()
 {
-    int offset = 16; // Offset to revert the signed range
-
-    // Decode the 32-bit integer into x, y, z positions
-    float x = ((vertexPosition & 0x3F) - offset);         // 6 bits for x
-    float y = (((vertexPosition >> 6) & 0x3F) - offset);  // 6 bits for y
-    float z = (((vertexPosition >> 12) & 0x3F) - offset); // 6 bits for z
-    int normalIndex = ((vertexPosition >> 18) & 0x7); // 3 bits for normal, assigned to face 1-6, see brightnessArr
-
-    // int position = (((vertexPosition >> 21) & 0x3F)); // 6 bits for texture
-
-    // decode texture coordinate - 5 bits each for 63x63 range
-    float u = (vertexPosition >> 21) & 0x1F; // bits 21–25
-    float v = (vertexPosition >> 26) & 0x1F; // bits 26–30
+    // Decode the 32-bit integer into x, y, z block corners
+    float x = float(vertexPosition & 0x1F);          // 5 bits for x
+    float y = float((vertexPosition >> 5) & 0x1F);   // 5 bits for y
+    float z = float((vertexPosition >> 10) & 0x1F);  // 5 bits for z
+    int normalIndex = ((vertexPosition >> 15) & 0x7); // 3 bits for normal, assigned to face 1-6, see brightnessArr
+
+    // decode texture coordinate - 5 bits each for 31x31 range
+    float u = (vertexPosition >> 18) & 0x1F; // bits 18–22
+    float v = (vertexPosition >> 23) & 0x1F; // bits 23–27
     u = u * texWidth;
     v = v * texHeight;
 
+    int ao = (vertexPosition >> 28) & 0x3;  // bits 28-29
+
 
     // 32 bits
-    //[start].vvvvvuuuuufffzzzzzzyyyyyyxxxxxx[end]
+    //[start]..aavvvvvuuuuufffzzzzzyyyyyxxxxx[end]
 
 
     // No normal or type used in this example for movement
-    vec3 decodedPos = vec3(x, y, z);
+    // corners are centred on the block, like the old signed positions
+    vec3 decodedPos = vec3(x, y, z) * blockRenderSize - 0.5 * blockRenderSize;
 
     gl_Position = projection * view * model * vec4(decodedPos + worldPos, 1.0);
 
@@ -71,6 +76,6 @@ void main()
     } else {
         ourColor = vec3(1.0, 1.0, 1.0);
         texCoord = vec2(u, v);
-        brightness = brightnessArr[normalIndex]; 
+        brightness = brightnessArr[normalIndex] * aoArr[ao];
     }
 }
@@ -1,6 +1,8 @@
 #ifndef SMOLGL_H
 #define SMOLGL_H
 
+#include "MemoryStats.h"
+
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -30,6 +32,7 @@ unsigned int smolLoadVertexBuffer(const void *buffer, int size, bool dynamic) {
     glBindBuffer(GL_ARRAY_BUFFER, id);
     glBufferData(GL_ARRAY_BUFFER, size, buffer,
                  dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    MemoryStats::add(MEM_GPU_BUFFERS, size);
 
     return id;
 }
@@ -62,10 +65,28 @@ unsigned int smolLoadVertexBufferElement(const void *buffer, int size,
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, buffer,
                  dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    MemoryStats::add(MEM_GPU_BUFFERS, size);
 
     return id;
 }
 
+// Unload a buffer loaded with smolLoadVertexBuffer*, the size is asked from GL
+// so callers don't have to remember it
+void smolUnloadBuffer(unsigned int id) {
+    if (id == 0)
+        return;
+
+    // any buffer can be bound to GL_COPY_READ_BUFFER without touching the
+    // VAO or the element buffer binding
+    int size = 0;
+    glBindBuffer(GL_COPY_READ_BUFFER, id);
+    glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    MemoryStats::remove(MEM_GPU_BUFFERS, size);
+
+    glDeleteBuffers(1, &id);
+}
+
 void smolUnloadVertexArray(unsigned int vaoId) {
     glBindVertexArray(0);
     glDeleteVertexArrays(1, &vaoId);
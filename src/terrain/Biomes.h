@@ -0,0 +1,271 @@
+#ifndef BIOMES_TERRAIN_H
+#define BIOMES_TERRAIN_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+#include "../ColumnCache.h"
+#include "../Noise.h"
+#include "../TerrainGenerator.h"
+#include "Caves.h"
+#include "Hills.h"
+#include "Plains.h"
+
+
+
+/*
+    Several generators across one world. Every BIOME_CELL blocks in x/z
+    there is a biome, picked from a temperature and a moisture noise:
+
+        moisture > MOIST     caves
+        temperature > WARM   hills
+        otherwise            plains
+
+    Biomes are worked out a region (REGION_CELLS x REGION_CELLS cells) at a
+    time and cached. A column's biome weights are the bilinear blend of the
+    4 biome points around it, so borders fade over a cell.
+
+    A chunk sits inside one cell (BIOME_CELL is a multiple of CHUNK_SIZE).
+    If all 4 corners of its cell are the same biome the chunk is handed to
+    that generator as is, which is most chunks. Only chunks on a border
+    blend: the surface height of every biome with weight there is sampled
+    (sampleSurface) and averaged by weight, then the column gets grass,
+    DIRT_DEPTH dirt and stone like the hills.
+*/
+
+class BiomeTerrainGenerator : public TerrainGenerator {
+public:
+    enum Biome : uint8_t { PLAINS, HILLS, CAVES, NUM_BIOMES };
+
+private:
+    static constexpr int BIOME_CELL = 64; // blocks
+    static constexpr int REGION_CELLS = 8;
+    static constexpr int CAVES_SURFACE_STEP = 4;
+    static constexpr int DIRT_DEPTH = 4;
+    static constexpr float WARM = 0.0f;
+    static constexpr float MOIST = 0.25f;
+    float frequency = 1.0f / 512.0f;
+
+    // biome points of a region and the one past its far edges, so every
+    // cell has its 4 corners
+    struct BiomeRegion {
+        uint8_t biome[(REGION_CELLS + 1) * (REGION_CELLS + 1)];
+    };
+    ColumnCache<BiomeRegion> regions{64};
+
+    TerrainGenerator *generators[NUM_BIOMES];
+
+    static int floorDiv(int a, int b) { return (int)std::floor((float)a / b); }
+
+    // biome at biome point (cell corner) px/pz, in cells
+    Biome biomeAt(int px, int pz) {
+        int regionX = floorDiv(px, REGION_CELLS);
+        int regionZ = floorDiv(pz, REGION_CELLS);
+        std::shared_ptr<const BiomeRegion> region =
+            regions.get(regionX, regionZ, [&](BiomeRegion &r) {
+                fillRegion(regionX, regionZ, r);
+            });
+        int x = px - regionX * REGION_CELLS;
+        int z = pz - regionZ * REGION_CELLS;
+        return (Biome)region->biome[x + z * (REGION_CELLS + 1)];
+    }
+
+    void fillRegion(int regionX, int regionZ, BiomeRegion &region) {
+        constexpr int points = REGION_CELLS + 1;
+        float temperature[points * points], moisture[points * points];
+        float step = BIOME_CELL * frequency;
+        float x0 = regionX * REGION_CELLS * step;
+        float z0 = regionZ * REGION_CELLS * step;
+        NoiseGrid2D(x0, z0, step, points, points, 0.0f, seed + 101, temperature);
+        NoiseGrid2D(x0, z0, step, points, points, 0.0f, seed + 102, moisture);
+        for (int i = 0; i < points * points; i++) {
+            region.biome[i] = moisture[i] > MOIST       ? CAVES
+                              : temperature[i] > WARM ? HILLS
+                                                      : PLAINS;
+        }
+        noiseSamples.fetch_add(2 * points * points, std::memory_order_relaxed);
+    }
+
+    // corners of the cell world block column x/z is in, and how far into it
+    void cellCorners(float x, float z, Biome corners[4], float &tx, float &tz) {
+        int cellX = (int)std::floor(x / BIOME_CELL);
+        int cellZ = (int)std::floor(z / BIOME_CELL);
+        corners[0] = biomeAt(cellX, cellZ);
+        corners[1] = biomeAt(cellX + 1, cellZ);
+        corners[2] = biomeAt(cellX, cellZ + 1);
+        corners[3] = biomeAt(cellX + 1, cellZ + 1);
+        tx = (x - cellX * BIOME_CELL) / BIOME_CELL;
+        tz = (z - cellZ * BIOME_CELL) / BIOME_CELL;
+    }
+
+    static void cornerWeights(const Biome corners[4], float tx, float tz,
+                              float weights[NUM_BIOMES]) {
+        for (int b = 0; b < NUM_BIOMES; b++) {
+            weights[b] = 0.0f;
+        }
+        weights[corners[0]] += (1 - tx) * (1 - tz);
+        weights[corners[1]] += tx * (1 - tz);
+        weights[corners[2]] += (1 - tx) * tz;
+        weights[corners[3]] += tx * tz;
+    }
+
+    // weighted surface height of a border column, and the type on top of
+    // the biome weighing the most. surfaceOf(biome, height, type)
+    template <typename SurfaceOf>
+    float blendedSurface(const float weights[NUM_BIOMES], SurfaceOf surfaceOf,
+                         BlockType &type) {
+        float height = 0.0f, heaviest = 0.0f;
+        type = BlockType::Grass;
+        for (int b = 0; b < NUM_BIOMES; b++) {
+            if (weights[b] <= 0.0f) {
+                continue;
+            }
+            float surface;
+            BlockType surfaceType;
+            surfaceOf((Biome)b, surface, surfaceType);
+            height += weights[b] * surface;
+            if (weights[b] > heaviest) {
+                heaviest = weights[b];
+                type = surfaceType;
+            }
+        }
+        return height;
+    }
+
+public:
+    // chunks handed to a single generator and chunks blended, for voxel-bench
+    std::atomic<uint64_t> interiorChunks{0};
+    std::atomic<uint64_t> borderChunks{0};
+
+    BiomeTerrainGenerator(int CHUNK_SIZE, int seed) : TerrainGenerator(CHUNK_SIZE, seed) {
+        generators[PLAINS] = new PlainsTerrainGenerator(CHUNK_SIZE, seed);
+        generators[HILLS] = new HillsTerrainGenerator(CHUNK_SIZE, seed);
+        generators[CAVES] = new CavesTerrainGenerator(CHUNK_SIZE, seed);
+    }
+
+    ~BiomeTerrainGenerator() {
+        for (TerrainGenerator *generator : generators) {
+            delete generator;
+        }
+    }
+
+    void generateChunk(glm::vec3 position, Block * blocks){
+        Biome corners[4];
+        float tx, tz;
+        cellCorners(position.x, position.z, corners, tx, tz);
+        if (corners[0] == corners[1] && corners[0] == corners[2] &&
+            corners[0] == corners[3]) {
+            interiorChunks.fetch_add(1, std::memory_order_relaxed);
+            generators[corners[0]]->generateChunk(position, blocks);
+            return;
+        }
+        borderChunks.fetch_add(1, std::memory_order_relaxed);
+
+        // the caves surface is a scan down through the density, too slow for
+        // every column. Take it every CAVES_SURFACE_STEP blocks (world
+        // aligned, the same in the next chunk) and interpolate
+        constexpr int step = CAVES_SURFACE_STEP;
+        int points = CHUNK_SIZE / step + 1;
+        float cavesSurface[(32 / step + 1) * (32 / step + 1)];
+        bool hasCaves = corners[0] == CAVES || corners[1] == CAVES ||
+                        corners[2] == CAVES || corners[3] == CAVES;
+        for (int i = 0; hasCaves && i < points * points; i++) {
+            BlockType ignored;
+            generators[CAVES]->sampleSurface(position.x + i % points * step,
+                                             position.z + i / points * step,
+                                             cavesSurface[i], ignored);
+        }
+
+        int baseY = (int)position.y;
+        for (int x = 0; x < CHUNK_SIZE; x++) {
+            for (int z = 0; z < CHUNK_SIZE; z++) {
+                float wx = position.x + x, wz = position.z + z;
+                float weights[NUM_BIOMES];
+                cornerWeights(corners, tx + (float)x / BIOME_CELL,
+                              tz + (float)z / BIOME_CELL, weights);
+                auto surfaceOf = [&](Biome biome, float &height, BlockType &type) {
+                    if (biome != CAVES) {
+                        generators[biome]->sampleSurface(wx, wz, height, type);
+                        return;
+                    }
+                    int px = x / step, pz = z / step;
+                    float fx = (float)(x % step) / step, fz = (float)(z % step) / step;
+                    auto at = [&](int dx, int dz) {
+                        return cavesSurface[(px + dx) + (pz + dz) * points];
+                    };
+                    height = noiseLerp(noiseLerp(at(0, 0), at(1, 0), fx),
+                                       noiseLerp(at(0, 1), at(1, 1), fx), fz);
+                    type = BlockType::Grass;
+                };
+                BlockType type;
+                int surface =
+                    (int)std::lround(blendedSurface(weights, surfaceOf, type));
+
+                surface -= baseY;
+                fillColumn(blocks, x, z, 0, surface - DIRT_DEPTH, BlockType::Stone);
+                fillColumn(blocks, x, z, surface - DIRT_DEPTH, surface,
+                           BlockType::Dirt);
+                fillColumn(blocks, x, z, surface, surface + 1, type);
+            }
+        }
+    }
+
+    // interior chunks go to their generator's generateChunks together, so
+    // it gets to share work between them too
+    void generateChunks(std::span<const glm::vec3> positions,
+                        std::span<Block *const> blocks) {
+        std::vector<glm::vec3> interiorPositions[NUM_BIOMES];
+        std::vector<Block *> interiorBlocks[NUM_BIOMES];
+        for (size_t i = 0; i < positions.size(); i++) {
+            Biome corners[4];
+            float tx, tz;
+            cellCorners(positions[i].x, positions[i].z, corners, tx, tz);
+            if (corners[0] == corners[1] && corners[0] == corners[2] &&
+                corners[0] == corners[3]) {
+                interiorPositions[corners[0]].push_back(positions[i]);
+                interiorBlocks[corners[0]].push_back(blocks[i]);
+            } else {
+                generateChunk(positions[i], blocks[i]);
+            }
+        }
+        for (int b = 0; b < NUM_BIOMES; b++) {
+            interiorChunks.fetch_add(interiorPositions[b].size(),
+                                     std::memory_order_relaxed);
+            generators[b]->generateChunks(interiorPositions[b], interiorBlocks[b]);
+        }
+    }
+
+    // the biome's own bounds inside a cell, nothing cheap on the borders
+    bool columnBounds(int x, int z, ColumnBounds &bounds){
+        Biome corners[4];
+        float tx, tz;
+        cellCorners(x, z, corners, tx, tz);
+        if (corners[0] != corners[1] || corners[0] != corners[2] ||
+            corners[0] != corners[3]) {
+            return false;
+        }
+        return generators[corners[0]]->columnBounds(x, z, bounds);
+    }
+
+    bool sampleSurface(float x, float z, float &height, BlockType &type){
+        Biome corners[4];
+        float tx, tz;
+        cellCorners(x, z, corners, tx, tz);
+        float weights[NUM_BIOMES];
+        cornerWeights(corners, tx, tz, weights);
+        auto surfaceOf = [&](Biome biome, float &h, BlockType &t) {
+            generators[biome]->sampleSurface(x, z, h, t);
+        };
+        height = blendedSurface(weights, surfaceOf, type);
+        return true;
+    }
+
+};
+
+
+#endif
@@ -3,61 +3,125 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
 
 
+#include "../ColumnCache.h"
+#include "../Noise.h"
 #include "../TerrainGenerator.h"
 
-#define STB_PERLIN_IMPLEMENTATION
-#include "../../libs/stb_perlin.h"
-
 
 
 class HillsTerrainGenerator : public TerrainGenerator {
     float frequency = 0.05f;
     float amplitude = 5.0f;
+    // world block y of the bottom of the top chunk layer, the hills sit on it
+    static constexpr int GROUND_LEVEL = -16;
+
+    // surface height of every column of a chunk, shared by the chunks
+    // stacked on top of each other
+    struct ColumnHeights {
+        int height[32 * 32]; // x + z * CHUNK_SIZE, CHUNK_SIZE <= 32
+    };
+    ColumnCache<ColumnHeights> columns{1024}; // 4 MB at most
+
 public:
     HillsTerrainGenerator(int CHUNK_SIZE, int seed) : TerrainGenerator(CHUNK_SIZE, seed) {}
 
-    void generateChunk(glm::vec3 position, Block * blocks){
+    // world block y of the grass block for a noise value
+    int heightFromNoise(float height) {
+        int blockHeight = CHUNK_SIZE - static_cast<int>((height + 1.0f) * amplitude);
+
+        // keep the hills inside the top chunk layer, there are no chunks above
+        return GROUND_LEVEL + (std::max)(5, (std::min)(blockHeight, CHUNK_SIZE - 1));
+    }
+
+    // world block y of the grass block for world column x/z
+    int columnHeight(float x, float z) {
+        float height;
+        NoiseGrid2D(x * frequency, z * frequency, frequency, 1, 1, 0.0f, seed, &height);
+        return heightFromNoise(height);
+    }
+
+    std::shared_ptr<const ColumnHeights> chunkHeights(glm::vec3 position) {
+        int chunkX = (int)std::floor(position.x / CHUNK_SIZE);
+        int chunkZ = (int)std::floor(position.z / CHUNK_SIZE);
+        return columns.get(chunkX, chunkZ, [&](ColumnHeights &h) {
+            // the whole chunk's noise in one go, same x + z * CHUNK_SIZE layout
+            float noise[32 * 32];
+            NoiseGrid2D(position.x * frequency, position.z * frequency, frequency,
+                        CHUNK_SIZE, CHUNK_SIZE, 0.0f, seed, noise);
+            for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+                h.height[i] = heightFromNoise(noise[i]);
+            }
+            noiseSamples.fetch_add(CHUNK_SIZE * CHUNK_SIZE,
+                                   std::memory_order_relaxed);
+        });
+    }
+
+    void fillChunk(glm::vec3 position, const ColumnHeights &heights, Block * blocks) {
+        int baseY = (int)position.y;
         // iterate x/z
         for(int x = 0; x < CHUNK_SIZE; x++) {
             for (int z = 0; z < CHUNK_SIZE; z++) {
-                float realx = (float) (position.x + x) * frequency;
-                float realz = (float) (position.z + z) * frequency;
-
-                float height = stb_perlin_noise3_seed(realx, 0.0f, realz, 0, 0, 0, seed);
-                int blockHeight = CHUNK_SIZE - static_cast<int>((height + 1.0f) * amplitude);
-
-                // limit block height to be within chunk bounds
-                blockHeight = (std::max)(5, (std::min)(blockHeight, CHUNK_SIZE - 1)); 
-                
-
-                // fill blocks up to the height
-
-                // fill grass
-                int index = getIndex(x, blockHeight, z);
-                blocks[index].isActive = true;
-                blocks[index].blockType = BlockType::Grass;
-
-                // fill dirt
-                for(int y = blockHeight - 1; y >= blockHeight - 5; y--) {
-                    if (y < 0) continue; // skip if below ground level
-                    index = getIndex(x, y, z);
-                    blocks[index].isActive = true;
-                    blocks[index].blockType = BlockType::Dirt;
-                }
-
-                // fill stone
-                for(int y = blockHeight - 5; y >= 0; y--) {
-                    int index = getIndex(x, y, z);
-                    blocks[index].isActive = true;
-                    blocks[index].blockType = BlockType::Stone;
-                }
+                // grass on top, 4 dirt under it, stone all the way down
+                int surface = heights.height[x + z * CHUNK_SIZE] - baseY;
+                fillColumn(blocks, x, z, 0, surface - 4, BlockType::Stone);
+                fillColumn(blocks, x, z, surface - 4, surface, BlockType::Dirt);
+                fillColumn(blocks, x, z, surface, surface + 1, BlockType::Grass);
+            }
+        }
+    }
+
+    void generateChunk(glm::vec3 position, Block * blocks){
+        fillChunk(position, *chunkHeights(position), blocks);
+    }
 
+    // chunks of the same column one after the other, so its heights are
+    // looked up once and not once per chunk
+    void generateChunks(std::span<const glm::vec3> positions,
+                        std::span<Block *const> blocks) {
+        std::vector<size_t> order(positions.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            if (positions[a].x != positions[b].x) {
+                return positions[a].x < positions[b].x;
+            }
+            return positions[a].z < positions[b].z;
+        });
+
+        std::shared_ptr<const ColumnHeights> heights;
+        for (size_t n = 0; n < order.size(); n++) {
+            glm::vec3 position = positions[order[n]];
+            if (n == 0 || position.x != positions[order[n - 1]].x ||
+                position.z != positions[order[n - 1]].z) {
+                heights = chunkHeights(position);
             }
+            fillChunk(position, *heights, blocks[order[n]]);
         }
     }
 
+    // stone 5 under the lowest grass, air over the highest
+    bool columnBounds(int x, int z, ColumnBounds &bounds){
+        std::shared_ptr<const ColumnHeights> heights = chunkHeights(glm::vec3(x, 0, z));
+        const int *first = heights->height;
+        const int *last = first + CHUNK_SIZE * CHUNK_SIZE;
+        bounds.solidBelow = *std::min_element(first, last) - 4;
+        bounds.emptyAbove = *std::max_element(first, last) + 1;
+        bounds.solidType = BlockType::Stone;
+        return true;
+    }
+
+    bool sampleSurface(float x, float z, float &height, BlockType &type){
+        height = columnHeight(x, z);
+        type = BlockType::Grass;
+        return true;
+    }
+
 };
 
 
@@ -14,33 +14,16 @@ public:
     PlainsTerrainGenerator(int CHUNK_SIZE, int seed) : TerrainGenerator(CHUNK_SIZE, seed) {}
 
     void generateChunk(glm::vec3 position, Block * blocks){
-        for(int y = 0; y < 10; y++){
-            for(int x = 0; x < CHUNK_SIZE; x++) {
-                for (int z = 0; z < CHUNK_SIZE; z++) {
-                    int index = getIndex(x, y, z);
-                    blocks[index].isActive = true;
-                    blocks[index].blockType = BlockType::Stone;
-                }
-            }
-        }
-        for(int y = 10; y < 15; y++){
-            for(int x = 0; x < CHUNK_SIZE; x++) {
-                for (int z = 0; z < CHUNK_SIZE; z++) {
-                    int index = getIndex(x, y, z);
-                    blocks[index].isActive = true;
-                    blocks[index].blockType = BlockType::Dirt;
-                }
-            }
-        }
-        for(int y = 15; y < 16; y++){
-            for(int x = 0; x < CHUNK_SIZE; x++) {
-                for (int z = 0; z < CHUNK_SIZE; z++) {
-                    int index = getIndex(x, y, z);
-                    blocks[index].isActive = true;
-                    blocks[index].blockType = BlockType::Grass;
-                }
-            }
-        }
+        fillLayers(blocks, 0, 10, BlockType::Stone);
+        fillLayers(blocks, 10, 15, BlockType::Dirt);
+        fillLayers(blocks, 15, 16, BlockType::Grass);
+    }
+
+    // flat grass at the top of the top layer of chunks
+    bool sampleSurface(float x, float z, float &height, BlockType &type){
+        height = 15 - CHUNK_SIZE;
+        type = BlockType::Grass;
+        return true;
     }
 
 };